@@ -0,0 +1,68 @@
+#include "capture/classifier/classifier.hpp"
+#include "utils/traffic_sketch/traffic_sketch.hpp"
+#include <benchmark/benchmark.h>
+#include <tins/tins.h>
+#include <cstdint>
+#include <vector>
+
+using namespace Tins;
+
+// synthetic TCP frames to a spread of destinations, serialized the way the
+// sniffer receives them off the wire
+static std::vector<PDU::serialization_type> makeFrames(size_t count) {
+    std::vector<PDU::serialization_type> frames;
+    frames.reserve(count);
+    const RawPDU payload(std::string(64, 'x'));
+    for (uint32_t i = 0; i < count; ++i) {
+        EthernetII frame = EthernetII() /
+                           IP(IPv4Address(0x08080808 + i * 2654435761u),
+                              IPv4Address("192.168.1.10")) /
+                           TCP(443, 50000) / payload;
+        frames.push_back(frame.serialize());
+    }
+    return frames;
+}
+
+// parsing a raw frame into PDUs, done by the sniffer before the handler
+static void BM_PacketParse(benchmark::State& state) {
+    const std::vector<PDU::serialization_type> frames = makeFrames(4096);
+    size_t i = 0;
+    for (auto _ : state) {
+        EthernetII pdu(frames[i].data(),
+                       static_cast<uint32_t>(frames[i].size()));
+        benchmark::DoNotOptimize(&pdu);
+        i = (i + 1) & 4095;
+    }
+}
+BENCHMARK(BM_PacketParse);
+
+// parse and classify, every destination already known as in steady state.
+// Capture::packetHandler only adds the queue operations on top
+static void BM_PacketHandler(benchmark::State& state) {
+    const std::vector<PDU::serialization_type> frames = makeFrames(4096);
+    PacketClassifier classifier;
+    for (const auto& frame : frames)
+        classifier.classify(
+            EthernetII(frame.data(), static_cast<uint32_t>(frame.size())),
+            true);
+    size_t i = 0;
+    for (auto _ : state) {
+        EthernetII pdu(frames[i].data(),
+                       static_cast<uint32_t>(frames[i].size()));
+        benchmark::DoNotOptimize(classifier.classify(pdu, true));
+        i = (i + 1) & 4095;
+    }
+}
+BENCHMARK(BM_PacketHandler);
+
+// the sketch update alone, over more destinations than it has counters
+static void BM_TrafficSketch(benchmark::State& state) {
+    TrafficSketch traffic;
+    uint32_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            traffic.add(0x08080808 + (i & 0xFFFF) * 2654435761u, 1500));
+        ++i;
+    }
+}
+BENCHMARK(BM_TrafficSketch);
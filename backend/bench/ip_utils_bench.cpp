@@ -0,0 +1,34 @@
+#include "utils/ip_utils/ip_utils.hpp"
+#include <benchmark/benchmark.h>
+
+// addresses with a mix of one, two and three digit octets
+static uint32_t nextIp(uint32_t i) { return 0x08080808 + i * 2654435761u; }
+
+static void BM_IpToStr(benchmark::State& state) {
+    uint32_t i = 0;
+    for (auto _ : state) {
+        std::string str = ipToStr(nextIp(i++));
+        benchmark::DoNotOptimize(str.data());
+    }
+}
+BENCHMARK(BM_IpToStr);
+
+static void BM_AppendIp(benchmark::State& state) {
+    uint32_t i = 0;
+    std::string buffer;
+    for (auto _ : state) {
+        buffer.clear();
+        appendIp(buffer, nextIp(i++));
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+BENCHMARK(BM_AppendIp);
+
+static void BM_DecodeIP(benchmark::State& state) {
+    uint32_t i = 0;
+    for (auto _ : state) {
+        std::string str = decodeIP(nextIp(i++));
+        benchmark::DoNotOptimize(str.data());
+    }
+}
+BENCHMARK(BM_DecodeIP);
@@ -0,0 +1,34 @@
+#include "utils/logger/logger.hpp"
+#include <benchmark/benchmark.h>
+
+// the cost seen by the calling thread. Lines are written to hovia-bench.log
+// in the working directory; a thread logging faster than the flusher drains
+// has lines dropped, which is part of what is measured
+static const bool configured = [] {
+    auto settings = std::make_shared<Settings>();
+    settings->setLogPath("hovia-bench.log");
+    Logger::getInstance().configure(settings);
+    return true;
+}();
+
+static void BM_LoggerLog(benchmark::State& state) {
+    const std::string message = "Pushed results of '8.8.8.8' IP to the queue";
+    for (auto _ : state)
+        Logger::getInstance().log(LogLevel::INFO, __func__, message);
+}
+BENCHMARK(BM_LoggerLog)->ThreadRange(1, 4)->UseRealTime();
+
+static void BM_LogMacro(benchmark::State& state) {
+    uint32_t i = 0;
+    for (auto _ : state)
+        LOG_INFO("Sent {} result(s) to {} websocket client(s)", i++, 3);
+}
+BENCHMARK(BM_LogMacro)->ThreadRange(1, 4)->UseRealTime();
+
+// a LOG_DEBUG call with verbose off, the common case on hot paths
+static void BM_LogDebugDisabled(benchmark::State& state) {
+    uint32_t i = 0;
+    for (auto _ : state)
+        LOG_DEBUG("Added '{}' IP to the cache", i++);
+}
+BENCHMARK(BM_LogDebugDisabled);
@@ -0,0 +1,41 @@
+#include "ipTracker/ip_queue/ip_queue.hpp"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstdint>
+
+// the IP queue between the capture and the lookup threads
+static IpQueue ipQueue;
+
+// every thread enqueues a destination and dequeues one, so the threads
+// contend on the lock from both ends the way capture and lookups do
+static void BM_IpQueue(benchmark::State& state) {
+    uint32_t ip = static_cast<uint32_t>(state.thread_index()) << 24;
+    uint32_t dequeued = 0;
+    pipelineTimeline timeline;
+    for (auto _ : state) {
+        ipQueue.push(ip, 0, ip & 0xFFF);
+        ++ip;
+        benchmark::DoNotOptimize(ipQueue.pop(dequeued, timeline,
+                                             std::chrono::milliseconds(100)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IpQueue)->ThreadRange(1, 8)->UseRealTime();
+
+// a destination already queued, every doubling of its traffic promotes it
+// and leaves a stale entry behind in the heap for pop() to skip
+static void BM_IpQueuePromote(benchmark::State& state) {
+    IpQueue queue;
+    uint32_t ip = 0;
+    pipelineTimeline timeline;
+    for (auto _ : state) {
+        queue.push(ip, 0, 1500);
+        for (uint64_t bytes = 3000; bytes < (1u << 20); bytes *= 2)
+            queue.promote(ip, bytes);
+        benchmark::DoNotOptimize(
+            queue.pop(ip, timeline, std::chrono::milliseconds(100)));
+        ++ip;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IpQueuePromote);
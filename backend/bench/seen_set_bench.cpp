@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+// the container behind Capture's seen-set
+using seenSet = std::unordered_set<std::uint32_t>;
+
+// random destinations, the same sequence on every run
+static std::vector<uint32_t> randomIps(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> ips(count);
+    for (uint32_t& ip : ips)
+        ip = rng();
+    return ips;
+}
+
+// building a set of range(0) destinations, reported per insert
+static void BM_SeenSetInsert(benchmark::State& state) {
+    const std::vector<uint32_t> ips =
+        randomIps(static_cast<size_t>(state.range(0)), 1);
+    for (auto _ : state) {
+        seenSet set;
+        for (uint32_t ip : ips)
+            set.insert(ip);
+        benchmark::DoNotOptimize(set.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SeenSetInsert)->Range(1 << 10, 1 << 20);
+
+// the per-packet check for a destination that is already known
+static void BM_SeenSetLookupHit(benchmark::State& state) {
+    const std::vector<uint32_t> ips =
+        randomIps(static_cast<size_t>(state.range(0)), 1);
+    const seenSet set(ips.begin(), ips.end());
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.find(ips[i]) != set.end());
+        if (++i == ips.size())
+            i = 0;
+    }
+}
+BENCHMARK(BM_SeenSetLookupHit)->Range(1 << 10, 1 << 20);
+
+// the check for a destination seen for the first time
+static void BM_SeenSetLookupMiss(benchmark::State& state) {
+    const std::vector<uint32_t> ips =
+        randomIps(static_cast<size_t>(state.range(0)), 1);
+    const std::vector<uint32_t> unknown = randomIps(1 << 16, 2);
+    const seenSet set(ips.begin(), ips.end());
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(set.find(unknown[i]) != set.end());
+        i = (i + 1) & (unknown.size() - 1);
+    }
+}
+BENCHMARK(BM_SeenSetLookupMiss)->Range(1 << 10, 1 << 20);
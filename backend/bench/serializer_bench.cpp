@@ -0,0 +1,48 @@
+#include "api/serializer/serializer.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <benchmark/benchmark.h>
+
+// a result shaped like a typical ip-api.com answer with a 15 hop route
+static traceResult makeResult() {
+    StringPool& pool = StringPool::getInstance();
+    traceResult result;
+    result.timestamp_ns = 1700000000000000000;
+    result.dest_info.ip = 0x08080808;
+    result.dest_info.country = pool.intern("United States");
+    result.dest_info.region = pool.intern("Virginia");
+    result.dest_info.isp = pool.intern("Google LLC");
+    result.dest_info.org = pool.intern("Google Public DNS");
+    result.dest_info.as = pool.intern("AS15169 Google LLC");
+    result.dest_info.asname = pool.intern("GOOGLE");
+    result.dest_info.latitude = 39.03;
+    result.dest_info.longitude = -77.5;
+    result.dest_info.time_zone = pool.intern("America/New_York");
+    for (uint32_t i = 0; i < 15; ++i)
+        result.hops.push_back({0x0A000001 + (i << 8), 1.25f + i * 3.7f});
+    return result;
+}
+
+static void BM_NlohmannDump(benchmark::State& state) {
+    traceResult result = makeResult();
+    for (auto _ : state) {
+        nlohmann::json j = result;
+        std::string msg = j.dump();
+        benchmark::DoNotOptimize(msg.data());
+    }
+}
+BENCHMARK(BM_NlohmannDump);
+
+static void BM_SerializeResult(benchmark::State& state) {
+    traceResult result = makeResult();
+    std::string buffer;
+    for (auto _ : state) {
+        buffer.clear();
+        serializeResult(buffer, result);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() *
+                            static_cast<int64_t>(buffer.size()));
+}
+BENCHMARK(BM_SerializeResult);
+
+BENCHMARK_MAIN();
@@ -1,14 +1,129 @@
 #include "api.hpp"
+#include "api/serializer/serializer.hpp"
 #include "ipTracker/ipTracker.hpp"
+#include "utils/clock/clock.hpp"
 #include "utils/common_structs.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
 #include "utils/logger/logger.hpp"
+#include "utils/settings/settings_utils/settings.hpp"
+#include "utils/string_pool/string_pool.hpp"
 #include <websocketpp/server.hpp>
 #include <nlohmann/json.hpp>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <thread>
 #include <atomic>
 
 using json = nlohmann::json;
 
+// frames queued for a client whose socket is not draining, the oldest are
+// dropped past this point
+constexpr size_t MAX_CLIENT_QUEUE = 256;
+// bytes websocketpp may hold unsent for a client before further results go
+// to its queue instead
+constexpr size_t MAX_CLIENT_BUFFERED = 1 << 20;
+// how often queued results are retried while some client has a backlog
+constexpr auto OUTBOX_RETRY = std::chrono::milliseconds(50);
+
+// most results a single /api/traces request may return
+constexpr size_t MAX_HISTORY_LIMIT = 10000;
+
+template <typename T>
+static bool parseNumber(const char* str, T& value) {
+    const char* end = str + std::strlen(str);
+    std::from_chars_result res = std::from_chars(str, end, value);
+    return res.ec == std::errc() && res.ptr == end;
+}
+
+// Builds a history query from the /api/traces url parameters. Returns false
+// with error set if a parameter is malformed, unknown is set if the query
+// names a country that was never seen and so cannot match anything
+static bool parseHistoryQuery(const crow::request& req, historyQuery& query,
+                              bool& unknown, std::string& error) {
+    unknown = false;
+    if (const char* ip = req.url_params.get("ip")) {
+        if (!parseIp(ip, query.ip)) {
+            error = "ip must be an IPv4 address";
+            return false;
+        }
+        query.hasIp = true;
+    }
+    if (const char* cidr = req.url_params.get("cidr")) {
+        if (!parseCidr(cidr, query.network, query.mask)) {
+            error = "cidr must be an IPv4 prefix like 10.0.0.0/8";
+            return false;
+        }
+        query.hasCidr = true;
+    }
+    if (const char* asn = req.url_params.get("asn")) {
+        // accept both "15169" and "AS15169"
+        if (std::strncmp(asn, "AS", 2) == 0)
+            asn += 2;
+        if (!parseNumber(asn, query.asn)) {
+            error = "asn must be an AS number";
+            return false;
+        }
+        query.hasAsn = true;
+    }
+    if (const char* country = req.url_params.get("country")) {
+        if (!StringPool::getInstance().find(country, query.country))
+            unknown = true;
+        query.hasCountry = true;
+    }
+    if (const char* from = req.url_params.get("from")) {
+        if (!parseNumber(from, query.from)) {
+            error = "from must be a unix timestamp in milliseconds";
+            return false;
+        }
+    }
+    if (const char* to = req.url_params.get("to")) {
+        if (!parseNumber(to, query.to)) {
+            error = "to must be a unix timestamp in milliseconds";
+            return false;
+        }
+    }
+    if (const char* limit = req.url_params.get("limit")) {
+        if (!parseNumber(limit, query.limit)) {
+            error = "limit must be a positive number";
+            return false;
+        }
+    }
+    query.limit = std::min(query.limit, MAX_HISTORY_LIMIT);
+    return true;
+}
+
+static websocketpp::frame::opcode::value opcodeFor(WireFormat format) {
+    return (format == WireFormat::JSON) ? websocketpp::frame::opcode::text
+                                        : websocketpp::frame::opcode::binary;
+}
+
+// empty message for a frame in format, the payload is encoded straight into
+// get_raw_payload()
+static server::message_ptr newFrame(WireFormat format) {
+    using message = server::message_ptr::element_type;
+    return std::make_shared<message>(message::con_msg_man_ptr(),
+                                     opcodeFor(format));
+}
+
+// Server frames are not masked, so a frame built here once can be written to
+// every connection as is. With permessage-deflate each connection compresses
+// with its own context and has to frame the message itself
+static void sealFrame(server::message_ptr::element_type& msg) {
+#ifndef HOVIA_WS_DEFLATE
+    const uint64_t size = msg.get_payload().size();
+    websocketpp::frame::basic_header header(msg.get_opcode(), size, true,
+                                            false);
+    msg.set_header(websocketpp::frame::prepare_header(
+        header, websocketpp::frame::extended_header(size)));
+    msg.set_prepared(true);
+#else
+    (void)msg;
+#endif
+}
+
 // Helper to convert crow log levels to the internal logger's LogLevel enum
 LogLevel convertCrowLogLevel(crow::LogLevel lvl) {
     switch (lvl) {
@@ -40,56 +155,96 @@ void CrowLogBridge::log(std::string message, crow::LogLevel level) {
 
 CrowLogBridge::~CrowLogBridge() = default;
 
-// JSON serialization for hopInfo struct
-void to_json(json& j, const hopInfo& h) {
-    j = json{{"hopIP", std::string(h.hopIP)}, {"latency", h.latency}};
-}
-
-// JSON serialization for destInfo struct
-void to_json(json& j, const destInfo& d) {
-    j = json{{"ip", std::string(d.ip)},
-             {"country", d.country},
-             {"region", d.region},
-             {"isp", d.isp},
-             {"org", d.org},
-             {"as", d.as},
-             {"asname", d.asname},
-             {"latitude", d.latitude},
-             {"longitude", d.longitude},
-             {"time_zone", d.time_zone}};
-}
-
-// JSON serialization for traceResult struct
-void to_json(json& j, const traceResult& t) {
-    j = json{{"dest_info", t.dest_info}, {"hops", t.hops}};
-}
-
 ApiServer::ApiServer(IpTracker* ipTracker)
-    : m_ipTracker(ipTracker), m_running(false) {
-    m_server.init_asio();  // initialize ASIO transport
+    : m_ipTracker(ipTracker),
+      m_running(false),
+      m_sendStrand(boost::asio::make_strand(m_ioContext)),
+      m_batchTimer(m_ioContext),
+      m_outboxTimer(m_ioContext),
+      m_sendTime(Metrics::getInstance().histogram(
+          "hovia_send_duration_seconds",
+          "Time taken to encode and send a batch of results to every "
+          "client")),
+      m_framesSent(Metrics::getInstance().counter(
+          "hovia_websocket_frames_sent_total",
+          "Result frames written to websocket clients")),
+      m_slowClientDrops(Metrics::getInstance().counter(
+          "hovia_slow_client_drops_total",
+          "Results dropped from the queue of a client that fell behind")) {
+    Metrics::getInstance().gauge(
+        "hovia_websocket_clients", "Connected websocket clients", [this]() {
+            return static_cast<double>(m_clientCount.load());
+        });
+
+    // initialize ASIO transport on the shared io_context
+    m_server.init_asio(&m_ioContext);
+
+    // pick the first supported encoding the client asked for, clients that
+    // request no subprotocol keep receiving JSON text frames
+    m_server.set_validate_handler([this](connHandle hdl) {
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        for (const std::string& subprotocol :
+             con->get_requested_subprotocols()) {
+            WireFormat format;
+            if (formatFromSubprotocol(subprotocol, format)) {
+                con->select_subprotocol(subprotocol);
+                break;
+            }
+        }
+        return true;
+    });
 
     m_server.set_open_handler([this](connHandle hdl) {
-        // store connection handle
-        m_hdl = hdl;
+        WireFormat format = WireFormat::JSON;
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        formatFromSubprotocol(con->get_subprotocol(), format);
+        // register the connection along with its negotiated format, then
+        // catch it up on recent results. Both happen under the clients lock
+        // so the snapshot holds exactly what was broadcast before the client
+        // joined
+        std::lock_guard<std::mutex> lock(m_clientsMutex);
+        wsClient& client = m_clients[hdl];
+        client.hdl = hdl;
+        client.format = format;
+
+        m_clientCount.store(m_clients.size());
+
+        configureReplay();
+        if (auto snapshot = m_replay.snapshot(format)) {
+            if (websocketpp::lib::error_code ec =
+                    con->send(*snapshot, opcodeFor(format)))
+                Logger::getInstance().log(LogLevel::ERROR, "open_handler",
+                                          "Failed to send replay snapshot: " +
+                                              ec.message());
+        }
+
+        // results held back while nobody was connected can go out now
+        notifyResults();
+        HOVIA_LOG(LogLevel::DEBUG, "open_handler",
+                  "Websocket client connected, {} client(s) attached",
+                  m_clients.size());
     });
 
     m_server.set_message_handler(
         [this](connHandle hdl, server::message_ptr msg) {
-            //
-            m_server.send(hdl, msg->get_payload(),
-                          websocketpp::frame::opcode::text);
+            handleMessage(hdl, msg->get_payload());
         });
 
-    m_server.set_close_handler([this](connHandle) {
-        // reset stored handle when the connection closes
-        m_hdl.reset();
-    });
+    // drop the client and anything still queued for it
+    auto removeClient = [this](connHandle hdl) {
+        std::lock_guard<std::mutex> lock(m_clientsMutex);
+        m_clients.erase(hdl);
+        m_clientCount.store(m_clients.size());
+    };
+    m_server.set_close_handler(removeClient);
+    m_server.set_fail_handler(removeClient);
 }
 
 ApiServer::~ApiServer() { stopAPI(); }
 
 // function to setup the crow HTTP routes for the different API endpoints
-// also handles CORS headers and GET/POST/OPTIONS for /api/settings
+// also handles CORS headers and GET/POST/OPTIONS for /api/settings, GET for
+// the /api/traces history query and GET /metrics for Prometheus
 void ApiServer::setupHttp(crow::SimpleApp& app) {
     auto setCorsHeaders = [](crow::response& res) {
         // allow localhost React app to access the API
@@ -167,6 +322,32 @@ void ApiServer::setupHttp(crow::SimpleApp& app) {
             res["hasVerbose"] = m_ipTracker->pSettings->hasVerbose();
 
             res["WebsocketPort"] = m_ipTracker->pSettings->getWebsocket();
+            res["batchSize"] = m_ipTracker->pSettings->getBatchSize();
+            res["batchWindow"] = m_ipTracker->pSettings->getBatchWindow();
+            res["replaySize"] = m_ipTracker->pSettings->getReplaySize();
+            res["replayWindow"] = m_ipTracker->pSettings->getReplayWindow();
+            res["apiThreads"] = m_ipTracker->pSettings->getApiThreads();
+            res["resultBacklog"] = m_ipTracker->pSettings->getResultBacklog();
+            res["historySize"] = m_ipTracker->pSettings->getHistorySize();
+            res["journalSegments"] =
+                m_ipTracker->pSettings->getJournalSegments();
+            res["snapshotInterval"] =
+                m_ipTracker->pSettings->getSnapshotInterval();
+            res["logFlushInterval"] =
+                m_ipTracker->pSettings->getLogFlushInterval();
+            res["binaryLog"] = m_ipTracker->pSettings->getBinaryLog();
+            res["logMaxSize"] = m_ipTracker->pSettings->getLogMaxSize();
+            res["logRotateHours"] = m_ipTracker->pSettings->getLogRotateHours();
+            res["logKeepFiles"] = m_ipTracker->pSettings->getLogKeepFiles();
+            res["logCompress"] = m_ipTracker->pSettings->getLogCompress();
+            res["pipelineTraceSample"] =
+                m_ipTracker->pSettings->getPipelineTraceSample();
+            res["lookupThreadsMin"] =
+                m_ipTracker->pSettings->getLookupThreadsMin();
+            res["lookupThreadsMax"] =
+                m_ipTracker->pSettings->getLookupThreadsMax();
+            res["prioritizeTraffic"] =
+                m_ipTracker->pSettings->getPrioritizeTraffic();
 
             crow::response response{res};
             setCorsHeaders(response);
@@ -241,12 +422,125 @@ void ApiServer::setupHttp(crow::SimpleApp& app) {
             if (body.has("WebsocketPort"))
                 m_ipTracker->pSettings->setWebsocket(body["WebsocketPort"].i());
 
+            if (body.has("batchSize"))
+                m_ipTracker->pSettings->setBatchSize(body["batchSize"].i());
+
+            if (body.has("batchWindow"))
+                m_ipTracker->pSettings->setBatchWindow(body["batchWindow"].i());
+
+            if (body.has("replaySize"))
+                m_ipTracker->pSettings->setReplaySize(body["replaySize"].i());
+
+            if (body.has("replayWindow"))
+                m_ipTracker->pSettings->setReplayWindow(
+                    body["replayWindow"].i());
+
+            if (body.has("apiThreads"))
+                m_ipTracker->pSettings->setApiThreads(body["apiThreads"].i());
+
+            if (body.has("resultBacklog"))
+                m_ipTracker->pSettings->setResultBacklog(
+                    body["resultBacklog"].i());
+
+            if (body.has("historySize")) {
+                m_ipTracker->pSettings->setHistorySize(
+                    body["historySize"].i());
+                // applied right away, shrinking evicts the oldest results
+                m_ipTracker->resizeHistory(
+                    m_ipTracker->pSettings->getHistorySize());
+            }
+
+            if (body.has("journalSegments"))
+                m_ipTracker->pSettings->setJournalSegments(
+                    body["journalSegments"].i());
+
+            if (body.has("snapshotInterval"))
+                m_ipTracker->pSettings->setSnapshotInterval(
+                    body["snapshotInterval"].i());
+
+            if (body.has("logFlushInterval"))
+                m_ipTracker->pSettings->setLogFlushInterval(
+                    body["logFlushInterval"].i());
+
+            if (body.has("binaryLog"))
+                m_ipTracker->pSettings->setBinaryLog(body["binaryLog"].b());
+
+            if (body.has("logMaxSize"))
+                m_ipTracker->pSettings->setLogMaxSize(body["logMaxSize"].i());
+
+            if (body.has("logRotateHours"))
+                m_ipTracker->pSettings->setLogRotateHours(
+                    body["logRotateHours"].i());
+
+            if (body.has("logKeepFiles"))
+                m_ipTracker->pSettings->setLogKeepFiles(
+                    body["logKeepFiles"].i());
+
+            if (body.has("logCompress"))
+                m_ipTracker->pSettings->setLogCompress(body["logCompress"].b());
+
+            if (body.has("pipelineTraceSample")) {
+                m_ipTracker->pSettings->setPipelineTraceSample(
+                    body["pipelineTraceSample"].i());
+                if (!m_pipelineTrace.setSamplePercent(
+                        m_ipTracker->pSettings->getPipelineTraceSample()))
+                    Logger::getInstance().log(
+                        LogLevel::ERROR, "settings",
+                        "Failed to open the pipeline trace file");
+            }
+
+            if (body.has("lookupThreadsMin"))
+                m_ipTracker->pSettings->setLookupThreadsMin(
+                    body["lookupThreadsMin"].i());
+
+            if (body.has("lookupThreadsMax"))
+                m_ipTracker->pSettings->setLookupThreadsMax(
+                    body["lookupThreadsMax"].i());
+
+            if (body.has("prioritizeTraffic"))
+                m_ipTracker->pSettings->setPrioritizeTraffic(
+                    body["prioritizeTraffic"].b());
+
             // m_ipTracker->pSettings->saveToFile();
 
             crow::response res(200, "Settings updated");
             setCorsHeaders(res);
             return res;
         });
+
+    // Query retained results, e.g. /api/traces?asn=15169&from=...&limit=50
+    // Every given parameter has to match, results come back newest first
+    CROW_ROUTE(app, "/api/traces")
+        .methods("GET"_method)([this,
+                                setCorsHeaders](const crow::request& req) {
+            historyQuery query;
+            bool unknown = false;
+            std::string error;
+            if (!parseHistoryQuery(req, query, unknown, error)) {
+                crow::response res(400, error);
+                setCorsHeaders(res);
+                return res;
+            }
+
+            std::vector<traceResult> results;
+            if (!unknown)
+                results = m_ipTracker->getHistory().query(query);
+
+            std::string body;
+            encodeResults(body, results, WireFormat::JSON);
+            crow::response res(200, body);
+            res.set_header("Content-Type", "application/json");
+            setCorsHeaders(res);
+            return res;
+        });
+
+    // counters, queue depths and stage latencies in the Prometheus text
+    // exposition format
+    CROW_ROUTE(app, "/metrics").methods("GET"_method)([]() {
+        crow::response res(200, Metrics::getInstance().render());
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
+    });
 }
 
 void ApiServer::startAPI() {
@@ -257,14 +551,24 @@ void ApiServer::startAPI() {
     // lifetime
     crow::logger::setHandler(new CrowLogBridge());
 
-    // HTTP server thread
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Initialising HTTP API at port 8080");
-    m_httpThread = std::thread([this]() {
-        crow::SimpleApp app;
-        setupHttp(app);
-        app.port(8080).concurrency(1).run();
+    const unsigned threads =
+        std::max<unsigned>(1, m_ipTracker->pSettings->getApiThreads());
+
+    // sampled destinations' timelines, for chrome://tracing or Perfetto
+    const std::string tracePath =
+        (std::filesystem::path(getConfigPath()) / "pipeline_trace.json")
+            .string();
+    if (!m_pipelineTrace.open(
+            tracePath, m_ipTracker->pSettings->getPipelineTraceSample()))
+        Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                  "Failed to open " + tracePath);
+
+    // HTTP server thread, crow runs its own pool of worker threads on top of
+    // it since it cannot be handed an external io_context
+    LOG_DEBUG("Initialising HTTP API at port 8080");
+    setupHttp(m_httpApp);
+    m_httpThread = std::thread([this, threads]() {
+        m_httpApp.port(8080).concurrency(threads).run();
     });
 
     // start websocket server listening on the given port
@@ -288,23 +592,19 @@ void ApiServer::startAPI() {
         m_server.set_error_channels(websocketpp::log::elevel::none);
     }
 
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Starting WS server on port " +
-                                      std::to_string(ws_port));
+    LOG_DEBUG("Starting WS server on port {}", ws_port);
 
     m_server.start_accept();
 
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(
-            LogLevel::INFO, __func__,
-            "WS server started and accepting connections");
+    LOG_DEBUG("WS server started and accepting connections");
 
-    // WebSocket message sending thread
-    m_sendThread = std::thread(&ApiServer::sendLoop, this);
+    // websocket connections and result delivery share one pool of threads
+    // running m_ioContext
+    for (unsigned i = 0; i < threads; ++i)
+        m_ioThreads.emplace_back([this]() { m_ioContext.run(); });
 
-    // Run WebSocket server on its own thread
-    m_wsThread = std::thread([this]() { m_server.run(); });
+    // pick up anything produced before the server was listening
+    notifyResults();
 }
 
 void ApiServer::stopAPI() {
@@ -312,82 +612,313 @@ void ApiServer::stopAPI() {
         return;  // prevent double stop
 
     try {
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(
-                LogLevel::INFO, __func__,
-                "Attempting to stop the webSocket server thread");
+        LOG_DEBUG("Attempting to stop the webSocket server thread");
         if (m_server.is_listening())
             m_server.stop_listening();
 
         m_server.stop();
 
-        m_server.get_io_service().stop();
+        m_ioContext.stop();
+        m_httpApp.stop();
     } catch (const std::exception& e) {
         Logger::getInstance().log(LogLevel::ERROR, __func__, e.what());
     }
 
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Attempting to join all API threads");
+    LOG_DEBUG("Attempting to join all API threads");
 
-    if (m_sendThread.joinable())
-        m_sendThread.join();
-
-    if (m_wsThread.joinable())
-        m_wsThread.join();
+    for (auto& t : m_ioThreads) {
+        if (t.joinable())
+            t.join();
+    }
+    m_ioThreads.clear();
 
     if (m_httpThread.joinable())
         m_httpThread.join();
+
+    m_pipelineTrace.close();
 }
 
-void ApiServer::sendResult(const traceResult& result) {
-    if (m_hdl.expired())
+void ApiServer::notifyResults() {
+    // one pending drain is enough, it takes everything queued when it runs
+    if (!m_running.load() || m_drainPosted.exchange(true))
         return;
+    boost::asio::post(m_sendStrand, [this]() { drainResults(); });
+}
 
-    json j = result;
-    std::string msg = j.dump();
+// runs on m_sendStrand. Moves queued results into the pending batch and sends
+// it once batchSize results have been collected; a partial batch is sent when
+// batchWindow ms have passed since it was started. batchSize <= 1 disables
+// batching, every result is then sent on its own.
+// While no client is attached results are left in the IpTracker's queue, the
+// open handler schedules another drain once one connects
+void ApiServer::drainResults() {
+    m_drainPosted.store(false);
+    if (m_clientCount.load() == 0)
+        return;
+    const size_t batchSize =
+        std::max<size_t>(1, m_ipTracker->pSettings->getBatchSize());
 
     try {
-        std::cout << msg;
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Sent message: '" + msg +
-                                          "' through websocket");
-        m_server.send(m_hdl, msg, websocketpp::frame::opcode::text);
-    } catch (const websocketpp::exception& e) {
+        for (;;) {
+            if (m_pending.size() < batchSize &&
+                !m_ipTracker->tryDequeueResults(
+                    m_pending, m_pendingTimelines,
+                    batchSize - m_pending.size()))
+                break;
+            if (m_pending.size() >= batchSize)
+                flushPending();
+        }
+
+        if (!m_pending.empty() && !m_batchTimerArmed) {
+            m_batchTimerArmed = true;
+            m_batchTimer.expires_after(std::chrono::milliseconds(
+                m_ipTracker->pSettings->getBatchWindow()));
+            m_batchTimer.async_wait(boost::asio::bind_executor(
+                m_sendStrand, [this](const boost::system::error_code& ec) {
+                    // a cancelled or superseded wait leaves the batch to the
+                    // timer that replaced it
+                    if (ec || m_batchTimer.expiry() >
+                                  std::chrono::steady_clock::now())
+                        return;
+                    flushPending();
+                }));
+        }
+    } catch (const std::exception& e) {
         Logger::getInstance().log(LogLevel::ERROR, __func__,
-                                  "Websocket send error: " +
-                                      std::string(e.what()));
+                                  std::string("Unexpected exception: ") +
+                                      e.what());
     }
 }
 
-// loop thread that dequeues trace results and sends them over websocket using
-// the dequeueResult(traceResult& tr) and sendResult(const traceResult& result)
-// functions
-void ApiServer::sendLoop() {
-    try {
-        while (m_running.load()) {
-            traceResult tr;
-            if (!m_ipTracker->dequeueResult(tr)) {
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(50));  // prevent busy wait
+// runs on m_sendStrand
+void ApiServer::flushPending() {
+    if (m_batchTimerArmed) {
+        m_batchTimer.cancel();
+        m_batchTimerArmed = false;
+    }
+    if (m_pending.empty())
+        return;
+
+    LOG_DEBUG("Dequeued {} result(s) from the result queue", m_pending.size());
+    sendResults(m_pending, m_pendingTimelines);
+    m_pending.clear();
+    m_pendingTimelines.clear();
+}
+
+// sends as much of the client's queue as its socket will take, returns false
+// if the connection failed
+bool ApiServer::flushClient(wsClient& client, server::connection& con) {
+    while (!client.outbox.empty() &&
+           con.get_buffered_amount() < MAX_CLIENT_BUFFERED) {
+        if (con.send(client.outbox.front().frame))
+            return false;
+        client.outbox.pop_front();
+    }
+    return true;
+}
+
+// runs on m_sendStrand. Retries the clients' queues every OUTBOX_RETRY while
+// any of them holds results, so a backlog drains on a quiet feed too instead
+// of waiting for the next result to be sent
+void ApiServer::scheduleOutboxFlush() {
+    if (m_outboxTimerArmed)
+        return;
+    m_outboxTimerArmed = true;
+    m_outboxTimer.expires_after(OUTBOX_RETRY);
+    m_outboxTimer.async_wait(boost::asio::bind_executor(
+        m_sendStrand, [this](const boost::system::error_code& ec) {
+            m_outboxTimerArmed = false;
+            if (!ec && m_running.load())
+                flushOutboxes();
+        }));
+}
+
+// runs on m_sendStrand
+void ApiServer::flushOutboxes() {
+    bool backlog = false;
+    {
+        std::lock_guard<std::mutex> lock(m_clientsMutex);
+        for (auto it = m_clients.begin(); it != m_clients.end();) {
+            wsClient& client = it->second;
+            if (client.outbox.empty()) {
+                ++it;
+                continue;
+            }
+            websocketpp::lib::error_code ec;
+            server::connection_ptr con =
+                m_server.get_con_from_hdl(client.hdl, ec);
+            if (ec || !flushClient(client, *con)) {
+                it = m_clients.erase(it);
+                m_clientCount.store(m_clients.size());
                 continue;
             }
-            if (m_ipTracker->pSettings->hasVerbose())
-                Logger::getInstance().log(LogLevel::INFO, __func__,
-                                          "Dequeued '" +
-                                              std::string(tr.dest_info.ip) +
-                                              "' from the result queue");
-
-            if (!m_hdl.expired())
-                sendResult(tr);
+            backlog |= !client.outbox.empty();
+            ++it;
         }
-    } catch (const std::exception& e) {
+    }
+    if (backlog)
+        scheduleOutboxFlush();
+}
+
+// handles a client's control message, currently {"subscribe": {...}} and
+// {"unsubscribe": true}. Every message is answered with a small JSON status
+void ApiServer::handleMessage(connHandle hdl, const std::string& payload) {
+    json reply;
+    json request = json::parse(payload, nullptr, false);
+
+    if (request.is_object() && request.contains("subscribe")) {
+        auto subscription = std::make_shared<Subscription>();
+        std::string error;
+        if (Subscription::compile(request["subscribe"], *subscription,
+                                  error)) {
+            std::lock_guard<std::mutex> lock(m_clientsMutex);
+            auto it = m_clients.find(hdl);
+            if (it != m_clients.end())
+                it->second.subscription = std::move(subscription);
+            reply = {{"subscription", "ok"}};
+        } else {
+            reply = {{"subscription", "error"}, {"message", error}};
+        }
+    } else if (request.is_object() && request.contains("unsubscribe")) {
+        std::lock_guard<std::mutex> lock(m_clientsMutex);
+        auto it = m_clients.find(hdl);
+        if (it != m_clients.end())
+            it->second.subscription.reset();
+        reply = {{"subscription", "ok"}};
+    } else {
+        reply = {{"subscription", "error"}, {"message", "unknown request"}};
+    }
+
+    websocketpp::lib::error_code ec;
+    m_server.send(hdl, reply.dump(), websocketpp::frame::opcode::text, ec);
+    if (ec)
         Logger::getInstance().log(LogLevel::ERROR, __func__,
-                                  std::string("Unexpected exception: ") +
-                                      e.what());
-    } catch (...) {
+                                  "Websocket reply error: " + ec.message());
+}
+
+// applies the current replay settings, must be called with m_clientsMutex held
+void ApiServer::configureReplay() {
+    m_replay.configure(m_ipTracker->pSettings->getReplaySize(),
+                       int64_t{m_ipTracker->pSettings->getReplayWindow()} *
+                           60 * 1000);
+}
+
+void ApiServer::seedReplay(const std::vector<traceResult>& results) {
+    std::lock_guard<std::mutex> lock(m_clientsMutex);
+    configureReplay();
+    m_replay.push(results);
+}
+
+void ApiServer::sendResults(const std::vector<traceResult>& results,
+                            const std::vector<pipelineTimeline>& timelines) {
+    const auto start = std::chrono::steady_clock::now();
+    const int64_t sentNs = Clock::monotonicNs();
+    for (size_t i = 0; i < results.size(); ++i)
+        m_pipelineTrace.record(results[i], timelines[i], sentNs);
+
+    std::lock_guard<std::mutex> lock(m_clientsMutex);
+    // kept for dashboards joining later. Only what is broadcast gets here,
+    // drainResults() leaves results in the tracker's backlog while nobody is
+    // connected and the first client to join receives them from there
+    configureReplay();
+    m_replay.push(results);
+
+    if (m_clients.empty() || results.empty())
+        return;
+
+    // with batching enabled results always go out as an array, even when the
+    // window closed on a single one, so clients see a consistent shape
+    const bool asArray = m_ipTracker->pSettings->getBatchSize() > 1;
+    auto encode = [asArray](const std::vector<traceResult>& selected,
+                            WireFormat format) {
+        server::message_ptr frame = newFrame(format);
+        std::string& out = frame->get_raw_payload();
+        if (asArray)
+            encodeResults(out, selected, format);
+        else
+            encodeResult(out, selected.front(), format);
+        sealFrame(*frame);
+        return frame;
+    };
+
+    // the full batch is encoded and framed once per format in use, and that
+    // one message is sent to or queued for every client that takes all of
+    // it. Clients whose subscription keeps only part of a batch get their
+    // own frame
+    std::array<server::message_ptr, WIRE_FORMAT_COUNT> frames{};
+    size_t sent = 0, dropped = 0;
+    bool backlog = false;
+
+    try {
+        for (auto it = m_clients.begin(); it != m_clients.end();) {
+            wsClient& client = it->second;
+            size_t idx = static_cast<size_t>(client.format);
+
+            websocketpp::lib::error_code ec;
+            server::connection_ptr con =
+                m_server.get_con_from_hdl(client.hdl, ec);
+            if (ec || !flushClient(client, *con)) {
+                it = m_clients.erase(it);
+                m_clientCount.store(m_clients.size());
+                continue;
+            }
+
+            // filter before serializing, so clients only pay for what they
+            // render
+            bool partial = false;
+            if (client.subscription) {
+                m_filtered.clear();
+                for (const traceResult& result : results)
+                    if (client.subscription->matches(result))
+                        m_filtered.push_back(result);
+                if (m_filtered.empty()) {
+                    backlog |= !client.outbox.empty();
+                    ++it;
+                    continue;
+                }
+                partial = m_filtered.size() != results.size();
+            }
+
+            server::message_ptr frame;
+            if (partial) {
+                frame = encode(m_filtered, client.format);
+            } else {
+                if (!frames[idx])
+                    frames[idx] = encode(results, client.format);
+                frame = frames[idx];
+            }
+
+            if (client.outbox.empty() &&
+                con->get_buffered_amount() < MAX_CLIENT_BUFFERED) {
+                if (!con->send(frame))
+                    ++sent;
+            } else {
+                // slow consumer, queue the frame and drop the oldest one
+                // once the queue is full
+                if (client.outbox.size() >= MAX_CLIENT_QUEUE) {
+                    client.dropped += client.outbox.front().results;
+                    dropped += client.outbox.front().results;
+                    client.outbox.pop_front();
+                }
+                client.outbox.push_back(
+                    {std::move(frame),
+                     partial ? m_filtered.size() : results.size()});
+            }
+            backlog |= !client.outbox.empty();
+            ++it;
+        }
+    } catch (const websocketpp::exception& e) {
         Logger::getInstance().log(LogLevel::ERROR, __func__,
-                                  "Unknown exception caught");
+                                  "Websocket send error: " +
+                                      std::string(e.what()));
     }
+    if (backlog)
+        scheduleOutboxFlush();
+
+    m_framesSent.inc(sent);
+    m_slowClientDrops.inc(dropped);
+    m_sendTime.observeSince(start);
+    LOG_DEBUG("Sent {} result(s) to {}/{} websocket client(s), dropped {} "
+              "queued result(s) for slow clients",
+              results.size(), sent, m_clients.size(), dropped);
 }
@@ -1,15 +1,66 @@
 #pragma once
 #include <websocketpp/server.hpp>
 #include <websocketpp/config/asio_no_tls.hpp>
+#ifdef HOVIA_WS_DEFLATE
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#endif
 #include "utils/common_structs.hpp"
+#include "api/replay_buffer/replay_buffer.hpp"
+#include "api/serializer/serializer.hpp"
+#include "api/subscription/subscription.hpp"
+#include "metrics/metrics.hpp"
+#include "pipeline_trace/pipeline_trace.hpp"
 #include <nlohmann/json.hpp>
 #include <thread>
+#include <array>
 #include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "crow_all.h"
 
 class IpTracker;
 
+#ifdef HOVIA_WS_DEFLATE
+// asio config with the permessage-deflate extension enabled, clients that
+// offer it get their frames compressed
+struct deflateConfig : public websocketpp::config::asio {
+        typedef deflateConfig type;
+        typedef websocketpp::config::asio base;
+
+        typedef base::concurrency_type concurrency_type;
+        typedef base::request_type request_type;
+        typedef base::response_type response_type;
+        typedef base::message_type message_type;
+        typedef base::con_msg_manager_type con_msg_manager_type;
+        typedef base::endpoint_msg_manager_type endpoint_msg_manager_type;
+        typedef base::alog_type alog_type;
+        typedef base::elog_type elog_type;
+        typedef base::rng_type rng_type;
+
+        struct transport_config : public base::transport_config {
+                typedef type::concurrency_type concurrency_type;
+                typedef type::alog_type alog_type;
+                typedef type::elog_type elog_type;
+                typedef type::request_type request_type;
+                typedef type::response_type response_type;
+                typedef websocketpp::transport::asio::basic_socket::endpoint
+                    socket_type;
+        };
+        typedef websocketpp::transport::asio::endpoint<transport_config>
+            transport_type;
+
+        struct permessage_deflate_config {};
+        typedef websocketpp::extensions::permessage_deflate::enabled<
+            permessage_deflate_config>
+            permessage_deflate_type;
+};
+
+typedef websocketpp::server<deflateConfig> server;
+#else
 typedef websocketpp::server<websocketpp::config::asio> server;
+#endif
 
 class CrowLogBridge : public crow::ILogHandler {
     public:
@@ -32,22 +83,81 @@ class ApiServer {
         // start webbsocket and HTTP servers on the specified ports
         void startAPI();
         void stopAPI();
-        // send traceResult to the connected websocket client
-        void sendResult(const traceResult& result);
+        // called by the producer after queueing results, schedules their
+        // delivery on the API's io_context
+        void notifyResults();
+        // send results to every connected websocket client, as one array
+        // frame when batching is enabled, and record their timelines. Runs on
+        // m_sendStrand
+        void sendResults(const std::vector<traceResult>& results,
+                         const std::vector<pipelineTimeline>& timelines);
+        // fills the replay buffer with results from before this run, oldest
+        // first, so dashboards connecting after a restart see them. Call
+        // before startAPI()
+        void seedReplay(const std::vector<traceResult>& results);
 
     private:
         IpTracker* m_ipTracker;
         using connHandle = websocketpp::connection_hdl;
-        std::thread m_httpThread;  // http server thread
+        crow::SimpleApp m_httpApp;  // http server
+        std::thread m_httpThread;   // http server thread
 
         std::atomic<bool> m_running;
+        // shared by the websocket server and result delivery, declared before
+        // everything that uses it so it is destroyed last
+        boost::asio::io_context m_ioContext;
+        std::vector<std::thread> m_ioThreads;  // threads running m_ioContext
         server m_server;           // websocket server instance
-        connHandle m_hdl;          // websocket connection handle
-        std::thread m_sendThread;  // thread that runs asynchronously to send
-                                   // websocket messages
 
-        std::thread m_wsThread;
+        // batching state, only touched from handlers running on m_sendStrand
+        boost::asio::strand<boost::asio::io_context::executor_type>
+            m_sendStrand;
+        boost::asio::steady_timer m_batchTimer;
+        bool m_batchTimerArmed = false;
+        std::vector<traceResult> m_pending;
+        std::vector<pipelineTimeline> m_pendingTimelines;  // one per result
+        std::atomic<bool> m_drainPosted{false};
+        // retries the clients' outboxes while any of them is non-empty
+        boost::asio::steady_timer m_outboxTimer;
+        bool m_outboxTimerArmed = false;
+
+        // a frame waiting in a client's outbox and the results it carries
+        struct queuedFrame {
+                server::message_ptr frame;
+                size_t results;
+        };
+
+        // a connected websocket client and the results it has yet to take
+        struct wsClient {
+                connHandle hdl;
+                WireFormat format = WireFormat::JSON;
+                // complete frames, shared with every other client that
+                // was sent the same batch
+                std::deque<queuedFrame> outbox;
+                uint64_t dropped = 0;  // results discarded from a full outbox
+                // results the client asked for, null receives everything
+                std::shared_ptr<Subscription> subscription;
+        };
+
+        // guards m_clients, m_replay and the scratch space below
+        std::mutex m_clientsMutex;
+        std::map<connHandle, wsClient, std::owner_less<connHandle>> m_clients;
+        std::atomic<size_t> m_clientCount{0};  // m_clients.size(), lock-free
+        // scratch space for clients whose subscription filters a batch
+        std::vector<traceResult> m_filtered;
+        ReplayBuffer m_replay;  // recent results replayed to new clients
+
+        Histogram& m_sendTime;
+        Counter& m_framesSent;
+        Counter& m_slowClientDrops;
+        PipelineTrace m_pipelineTrace;  // timelines of the results sent
 
-        void sendLoop();
+        void drainResults();
+        void flushPending();
+        bool flushClient(wsClient& client, server::connection& con);
+        void scheduleOutboxFlush();
+        void flushOutboxes();
+        void handleMessage(connHandle hdl, const std::string& payload);
+        void configureReplay();
         void setupHttp(crow::SimpleApp& app);
 };
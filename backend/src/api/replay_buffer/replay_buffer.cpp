@@ -0,0 +1,74 @@
+#include "replay_buffer.hpp"
+#include "utils/clock/clock.hpp"
+#include <algorithm>
+
+void ReplayBuffer::configure(size_t capacity, int64_t maxAgeMs) {
+    m_maxAgeMs = maxAgeMs;
+    if (capacity == m_ring.size())
+        return;
+
+    // keep the newest results that still fit, oldest first
+    std::vector<traceResult> ring;
+    ring.reserve(capacity);
+    size_t keep = std::min(m_count, capacity);
+    for (size_t i = m_count - keep; i < m_count; ++i)
+        ring.push_back(m_ring[(m_head + i) % m_ring.size()]);
+
+    m_count = ring.size();
+    ring.resize(capacity);
+    m_ring = std::move(ring);
+    m_head = 0;
+    ++m_version;
+}
+
+void ReplayBuffer::push(const std::vector<traceResult>& results) {
+    if (m_ring.empty())
+        return;
+
+    for (const traceResult& result : results) {
+        if (m_count < m_ring.size()) {
+            m_ring[(m_head + m_count) % m_ring.size()] = result;
+            ++m_count;
+        } else {
+            // full, overwrite the oldest
+            m_ring[m_head] = result;
+            m_head = (m_head + 1) % m_ring.size();
+        }
+    }
+    ++m_version;
+}
+
+void ReplayBuffer::expire() {
+    if (m_maxAgeMs <= 0)
+        return;
+
+    const int64_t now = Clock::nowMs();
+    size_t expired = 0;
+    while (m_count > 0 && now - m_ring[m_head].timestampMs() > m_maxAgeMs) {
+        m_head = (m_head + 1) % m_ring.size();
+        --m_count;
+        ++expired;
+    }
+    if (expired)
+        ++m_version;
+}
+
+std::shared_ptr<const std::string> ReplayBuffer::snapshot(WireFormat format) {
+    expire();
+    if (m_count == 0)
+        return nullptr;
+
+    cachedSnapshot& cached = m_snapshots[static_cast<size_t>(format)];
+    if (cached.version != m_version) {
+        std::vector<traceResult> ordered;
+        ordered.reserve(m_count);
+        for (size_t i = 0; i < m_count; ++i)
+            ordered.push_back(m_ring[(m_head + i) % m_ring.size()]);
+
+        auto payload = std::make_shared<std::string>();
+        encodeResults(*payload, ordered, format);
+        cached.payload = std::move(payload);
+        cached.version = m_version;
+    }
+    return cached.payload;
+}
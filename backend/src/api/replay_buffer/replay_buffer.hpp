@@ -0,0 +1,42 @@
+#pragma once
+#include "api/serializer/serializer.hpp"
+#include "utils/common_structs.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Ring buffer of the most recent results, used to bring dashboards that
+// connect late up to date. The retained results are encoded into a snapshot
+// once per format and the encoding is shared by every client that connects
+// until the buffer changes again.
+//
+// Not thread-safe, the owner serialises access.
+class ReplayBuffer {
+    public:
+        // keeps at most capacity results, and when maxAgeMs is non-zero only
+        // those younger than maxAgeMs
+        void configure(size_t capacity, int64_t maxAgeMs);
+        void push(const std::vector<traceResult>& results);
+
+        // returns the retained results encoded as one array in format, or
+        // null when there is nothing to replay
+        std::shared_ptr<const std::string> snapshot(WireFormat format);
+
+    private:
+        // drops results older than m_maxAgeMs relative to now
+        void expire();
+
+        std::vector<traceResult> m_ring;
+        size_t m_head = 0;   // index of the oldest result
+        size_t m_count = 0;  // number of retained results
+        int64_t m_maxAgeMs = 0;
+
+        uint64_t m_version = 0;  // bumped whenever the contents change
+        struct cachedSnapshot {
+                uint64_t version = UINT64_MAX;
+                std::shared_ptr<const std::string> payload;
+        };
+        std::array<cachedSnapshot, WIRE_FORMAT_COUNT> m_snapshots;
+};
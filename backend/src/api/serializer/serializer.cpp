@@ -0,0 +1,273 @@
+#include "serializer.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <charconv>
+#include <cmath>
+#include <string_view>
+
+using json = nlohmann::json;
+
+// JSON serialization for hopInfo struct, latency is rounded to microseconds
+// so the float does not print as a long tail of digits
+void to_json(json& j, const hopInfo& h) {
+    j = json{{"hopIP", ipToStr(h.hopIP)},
+             {"latency", std::round(h.latency * 1000.0) / 1000.0}};
+}
+
+// JSON serialization for destInfo struct, interned ids are resolved back to
+// their strings
+void to_json(json& j, const destInfo& d) {
+    const StringPool& pool = StringPool::getInstance();
+    j = json{{"ip", ipToStr(d.ip)},
+             {"country", pool.view(d.country)},
+             {"region", pool.view(d.region)},
+             {"isp", pool.view(d.isp)},
+             {"org", pool.view(d.org)},
+             {"as", pool.view(d.as)},
+             {"asname", pool.view(d.asname)},
+             {"latitude", d.latitude},
+             {"longitude", d.longitude},
+             {"time_zone", pool.view(d.time_zone)}};
+}
+
+// JSON serialization for traceResult struct
+void to_json(json& j, const traceResult& t) {
+    json hops = json::array();
+    for (const hopInfo& hop : t.hops)
+        hops.push_back(hop);
+    j = json{{"timestamp", t.timestampMs()},
+             {"timestamp_ns", t.timestamp_ns},
+             {"dest_info", t.dest_info},
+             {"hops", std::move(hops)}};
+}
+
+// Checks the UTF-8 sequence starting at str[i] by the rules of nlohmann's
+// decoder. Sets len to its length if it is valid, otherwise to the bytes up
+// to the first one that does not belong to it, which starts the next one
+static bool decodeUtf8(std::string_view str, std::size_t i, std::size_t& len) {
+    const unsigned char lead = static_cast<unsigned char>(str[i]);
+    std::size_t need;
+    unsigned char lo = 0x80, hi = 0xBF;  // range of the next byte
+    len = 1;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        need = 1;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        need = 2;
+        // no overlong forms, no surrogates
+        if (lead == 0xE0)
+            lo = 0xA0;
+        else if (lead == 0xED)
+            hi = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        need = 3;
+        // no overlong forms, nothing past U+10FFFF
+        if (lead == 0xF0)
+            lo = 0x90;
+        else if (lead == 0xF4)
+            hi = 0x8F;
+    } else {
+        return false;
+    }
+    for (; len <= need; ++len) {
+        if (i + len == str.size())
+            return false;
+        const unsigned char c = static_cast<unsigned char>(str[i + len]);
+        if (c < lo || c > hi)
+            return false;
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    return true;
+}
+
+// appends str as a quoted JSON string, escaped like dump(), with every
+// invalid UTF-8 sequence replaced by U+FFFD like
+// nlohmann::json::error_handler_t::replace. Runs of plain characters are
+// copied in one append
+static void appendString(std::string& out, std::string_view str) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    std::size_t runStart = 0;
+    std::size_t i = 0;
+    while (i < str.size()) {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x80) {
+            std::size_t len;
+            if (!decodeUtf8(str, i, len)) {
+                out.append(str.data() + runStart, i - runStart);
+                out.append("\xEF\xBF\xBD");
+                runStart = i + len;
+            }
+            i += len;
+            continue;
+        }
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            ++i;
+            continue;
+        }
+
+        out.append(str.data() + runStart, i - runStart);
+        runStart = ++i;
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\b':
+                out.append("\\b");
+                break;
+            case '\f':
+                out.append("\\f");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                out.append("\\u00");
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xF]);
+        }
+    }
+    out.append(str.data() + runStart, str.size() - runStart);
+    out.push_back('"');
+}
+
+// nlohmann's own float formatting, so 0 prints as 0.0 and exponents look
+// the same as in dump()
+static void appendDouble(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out.append("null");
+        return;
+    }
+    char buf[64];
+    out.append(buf, nlohmann::detail::to_chars(buf, buf + sizeof(buf), value));
+}
+
+// rounded to microseconds exactly as to_json(hopInfo) does
+static void appendLatency(std::string& out, float value) {
+    appendDouble(out, std::round(value * 1000.0) / 1000.0);
+}
+
+static void appendInt(std::string& out, int64_t value) {
+    char buf[24];
+    std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+static void appendKey(std::string& out, std::string_view key) {
+    out.push_back('"');
+    out.append(key);
+    out.append("\":");
+}
+
+void serializeResult(std::string& out, const traceResult& result) {
+    const StringPool& pool = StringPool::getInstance();
+    const destInfo& d = result.dest_info;
+
+    out.append("{\"timestamp\":");
+    appendInt(out, result.timestampMs());
+    out.append(",\"timestamp_ns\":");
+    appendInt(out, result.timestamp_ns);
+    out.append(",\"dest_info\":{");
+    appendKey(out, "ip");
+    out.push_back('"');
+    appendIp(out, d.ip);
+    out.append("\",");
+    appendKey(out, "country");
+    appendString(out, pool.view(d.country));
+    out.push_back(',');
+    appendKey(out, "region");
+    appendString(out, pool.view(d.region));
+    out.push_back(',');
+    appendKey(out, "isp");
+    appendString(out, pool.view(d.isp));
+    out.push_back(',');
+    appendKey(out, "org");
+    appendString(out, pool.view(d.org));
+    out.push_back(',');
+    appendKey(out, "as");
+    appendString(out, pool.view(d.as));
+    out.push_back(',');
+    appendKey(out, "asname");
+    appendString(out, pool.view(d.asname));
+    out.push_back(',');
+    appendKey(out, "latitude");
+    appendDouble(out, d.latitude);
+    out.push_back(',');
+    appendKey(out, "longitude");
+    appendDouble(out, d.longitude);
+    out.push_back(',');
+    appendKey(out, "time_zone");
+    appendString(out, pool.view(d.time_zone));
+    out.append("},\"hops\":[");
+
+    bool first = true;
+    for (const hopInfo& hop : result.hops) {
+        if (!first)
+            out.push_back(',');
+        first = false;
+        out.append("{\"hopIP\":\"");
+        appendIp(out, hop.hopIP);
+        out.append("\",\"latency\":");
+        appendLatency(out, hop.latency);
+        out.push_back('}');
+    }
+    out.append("]}");
+}
+
+bool formatFromSubprotocol(std::string_view subprotocol, WireFormat& format) {
+    if (subprotocol == JSON_SUBPROTOCOL)
+        format = WireFormat::JSON;
+    else if (subprotocol == CBOR_SUBPROTOCOL)
+        format = WireFormat::CBOR;
+    else if (subprotocol == MSGPACK_SUBPROTOCOL)
+        format = WireFormat::MSGPACK;
+    else
+        return false;
+    return true;
+}
+
+void encodeResult(std::string& out, const traceResult& result,
+                  WireFormat format) {
+    switch (format) {
+        case WireFormat::CBOR:
+            json::to_cbor(json(result), out);
+            break;
+        case WireFormat::MSGPACK:
+            json::to_msgpack(json(result), out);
+            break;
+        default:
+            serializeResult(out, result);
+            break;
+    }
+}
+
+void encodeResults(std::string& out, const std::vector<traceResult>& results,
+                   WireFormat format) {
+    if (format == WireFormat::JSON) {
+        out.push_back('[');
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (i)
+                out.push_back(',');
+            serializeResult(out, results[i]);
+        }
+        out.push_back(']');
+        return;
+    }
+
+    json batch = json::array();
+    for (const traceResult& result : results)
+        batch.push_back(result);
+    if (format == WireFormat::CBOR)
+        json::to_cbor(batch, out);
+    else
+        json::to_msgpack(batch, out);
+}
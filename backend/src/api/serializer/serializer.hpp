@@ -0,0 +1,41 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// nlohmann::json conversions, used wherever a result has to be embedded in a
+// larger JSON document
+void to_json(nlohmann::json& j, const hopInfo& h);
+void to_json(nlohmann::json& j, const destInfo& d);
+void to_json(nlohmann::json& j, const traceResult& t);
+
+// Streams the JSON form of result onto the end of out. Produces the text
+// of to_json() + dump(-1, ' ', false, error_handler_t::replace), so invalid
+// UTF-8 becomes U+FFFD instead of throwing, except that keys keep the order
+// of the structs rather than being sorted. No intermediate tree is built,
+// and a buffer reused across calls makes serialization allocation-free
+void serializeResult(std::string& out, const traceResult& result);
+
+// Encodings a websocket client can negotiate through its subprotocol.
+// JSON goes out as text frames, the others as binary frames
+enum class WireFormat { JSON, CBOR, MSGPACK };
+constexpr std::size_t WIRE_FORMAT_COUNT = 3;
+
+// subprotocol names, e.g. new WebSocket(url, ["hovia.cbor"])
+constexpr char JSON_SUBPROTOCOL[] = "hovia.json";
+constexpr char CBOR_SUBPROTOCOL[] = "hovia.cbor";
+constexpr char MSGPACK_SUBPROTOCOL[] = "hovia.msgpack";
+
+// maps a requested subprotocol to its format, returns false for unknown names
+bool formatFromSubprotocol(std::string_view subprotocol, WireFormat& format);
+
+// appends result to out in the given format
+void encodeResult(std::string& out, const traceResult& result,
+                  WireFormat format);
+
+// appends results to out as a single array in the given format, used when
+// several results are batched into one websocket frame
+void encodeResults(std::string& out, const std::vector<traceResult>& results,
+                   WireFormat format);
@@ -0,0 +1,156 @@
+#include "subscription.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+// bounds the work a single client can make every result go through
+constexpr size_t MAX_FILTER_ENTRIES = 1024;
+
+bool Subscription::compile(const nlohmann::json& spec, Subscription& out,
+                           std::string& error) {
+    out = Subscription{};
+    if (!spec.is_object()) {
+        error = "subscribe expects an object";
+        return false;
+    }
+
+    auto listField = [&](const char* key) -> const nlohmann::json* {
+        auto it = spec.find(key);
+        if (it == spec.end())
+            return nullptr;
+        if (!it->is_array() || it->size() > MAX_FILTER_ENTRIES) {
+            error = std::string(key) + " must be an array of at most " +
+                    std::to_string(MAX_FILTER_ENTRIES) + " entries";
+            return nullptr;
+        }
+        return &*it;
+    };
+
+    if (const nlohmann::json* countries = listField("countries")) {
+        for (const auto& country : *countries) {
+            if (!country.is_string()) {
+                error = "countries must contain strings";
+                return false;
+            }
+            out.m_pendingCountries.push_back(country.get<std::string>());
+        }
+        out.m_filterCountries = true;
+        out.resolvePending();
+    }
+
+    if (const nlohmann::json* asns = listField("asns")) {
+        for (const auto& asn : *asns) {
+            if (!asn.is_number_unsigned() ||
+                asn.get<uint64_t>() > std::numeric_limits<uint32_t>::max()) {
+                error = "asns must contain AS numbers";
+                return false;
+            }
+            out.m_asns.push_back(asn.get<uint32_t>());
+        }
+        std::sort(out.m_asns.begin(), out.m_asns.end());
+    }
+
+    if (const nlohmann::json* cidrs = listField("cidrs")) {
+        for (const auto& entry : *cidrs) {
+            cidr range{};
+            if (!entry.is_string() ||
+                !parseCidr(entry.get_ref<const std::string&>(), range.network,
+                           range.mask)) {
+                error = "cidrs must contain a.b.c.d/len strings";
+                return false;
+            }
+            out.m_cidrs.push_back(range);
+        }
+    }
+
+    if (!error.empty())
+        return false;
+
+    if (auto it = spec.find("minHops"); it != spec.end()) {
+        if (!it->is_number_unsigned()) {
+            error = "minHops must be a non-negative integer";
+            return false;
+        }
+        out.m_minHops = it->get<size_t>();
+    }
+
+    for (auto [key, field] : {std::pair{"minLatency", &out.m_minLatency},
+                              std::pair{"maxLatency", &out.m_maxLatency}}) {
+        auto it = spec.find(key);
+        if (it == spec.end())
+            continue;
+        if (!it->is_number() || it->get<double>() < 0) {
+            error = std::string(key) + " must be a non-negative number";
+            return false;
+        }
+        *field = it->get<float>();
+    }
+    return true;
+}
+
+// looked up rather than interned, so clients cannot grow the pool. A name it
+// does not hold is on no result yet, and is retried once it has grown
+void Subscription::resolvePending() {
+    const StringPool& pool = StringPool::getInstance();
+    size_t poolSize = pool.size();
+    if (poolSize == m_poolSize)
+        return;
+    m_poolSize = poolSize;
+
+    size_t resolved = 0;
+    auto it = std::remove_if(
+        m_pendingCountries.begin(), m_pendingCountries.end(),
+        [&](const std::string& name) {
+            stringId id;
+            if (!pool.find(name, id))
+                return false;
+            m_countries.push_back(id);
+            ++resolved;
+            return true;
+        });
+    m_pendingCountries.erase(it, m_pendingCountries.end());
+    if (resolved > 0)
+        std::sort(m_countries.begin(), m_countries.end());
+}
+
+bool Subscription::matches(const traceResult& result) {
+    const destInfo& d = result.dest_info;
+
+    if (result.hops.size() < m_minHops)
+        return false;
+
+    if (m_minLatency > 0.0f || m_maxLatency > 0.0f) {
+        if (result.hops.empty())
+            return false;
+        float latency = result.hops.items[result.hops.size() - 1].latency;
+        if (latency < m_minLatency ||
+            (m_maxLatency > 0.0f && latency > m_maxLatency))
+            return false;
+    }
+
+    if (m_filterCountries &&
+        !std::binary_search(m_countries.begin(), m_countries.end(),
+                            d.country)) {
+        // the result's country may be one of the pending names
+        if (m_pendingCountries.empty())
+            return false;
+        resolvePending();
+        if (!std::binary_search(m_countries.begin(), m_countries.end(),
+                                d.country))
+            return false;
+    }
+
+    if (!m_asns.empty() &&
+        !std::binary_search(m_asns.begin(), m_asns.end(), d.asn))
+        return false;
+
+    if (!m_cidrs.empty() &&
+        std::none_of(m_cidrs.begin(), m_cidrs.end(), [&](const cidr& range) {
+            return (d.ip & range.mask) == range.network;
+        }))
+        return false;
+
+    return true;
+}
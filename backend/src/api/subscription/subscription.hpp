@@ -0,0 +1,51 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+// A websocket client's subscription, compiled from a message such as
+//   {"subscribe": {"countries": ["Germany"], "asns": [15169],
+//                  "cidrs": ["8.8.0.0/16"], "minHops": 3,
+//                  "minLatency": 20, "maxLatency": 250}}
+// Every field is optional. A result has to satisfy each field that is given,
+// and matches a list field if it matches any of its entries. Latencies are
+// compared against the last recorded hop, in milliseconds.
+//
+// Names are turned into StringPool ids and CIDRs into masks up front, so
+// matches() only does integer compares. Names the pool does not hold yet are
+// kept aside and looked up again once the pool has grown, so a country first
+// seen after the client subscribed still matches.
+class Subscription {
+    public:
+        // fills out from the object under "subscribe", returns false and sets
+        // error if the spec is malformed
+        static bool compile(const nlohmann::json& spec, Subscription& out,
+                            std::string& error);
+
+        // not thread-safe, resolves pending country names as a side effect
+        bool matches(const traceResult& result);
+
+    private:
+        struct cidr {
+                uint32_t network;
+                uint32_t mask;
+        };
+
+        // moves the names of m_pendingCountries the pool now holds into
+        // m_countries, a no-op while the pool has not grown
+        void resolvePending();
+
+        std::vector<stringId> m_countries;  // sorted
+        // set when countries was given, even if none of them are known
+        bool m_filterCountries = false;
+        // countries the pool did not hold yet, and its size when they were
+        // last looked up
+        std::vector<std::string> m_pendingCountries;
+        size_t m_poolSize = 0;
+        std::vector<uint32_t> m_asns;       // sorted
+        std::vector<cidr> m_cidrs;
+        size_t m_minHops = 0;
+        float m_minLatency = 0.0f;
+        float m_maxLatency = 0.0f;  // 0 means no upper bound
+};
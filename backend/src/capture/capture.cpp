@@ -1,62 +1,108 @@
 #include "capture.hpp"
 #include "ipTracker/ipTracker.hpp"
 #include "platform_dependent/network_interface/network_interface.hpp"
+#include "utils/clock/clock.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
 #include "utils/logger/logger.hpp"
+#include <algorithm>
 #include <pcap/pcap.h>
+#include <random>
 #include <tins/tins.h>
 #include <thread>
 #include <unordered_set>
 
 using namespace Tins;
 
-Capture::Capture(IpTracker* ipTracker) : m_ipTracker(ipTracker) {}
+Capture::Capture(IpTracker* ipTracker)
+    : m_ipTracker(ipTracker),
+      m_packets(Metrics::getInstance().counter(
+          "hovia_captured_packets_total", "Packets seen by the capture")),
+      m_newDestinations(Metrics::getInstance().counter(
+          "hovia_new_destinations_total",
+          "Destinations seen for the first time and queued for tracing")) {}
 
-// check if a given ipv4 address is contained in the ipCache unordered_set
-bool Capture::isKnown(const uint32_t& ip) {
-    return (m_ipCache.find(ip) != m_ipCache.end());
+void Capture::restoreSeen(const std::vector<uint32_t>& ips) {
+    m_classifier.restoreSeen(ips);
 }
 
-void Capture::addIp(const uint32_t& ip) { m_ipCache.insert(ip); }
-
-std::string decodeIP(uint32_t ip) {
-    // If ip is in host byte order, convert to network order:
-    uint32_t net_ip = htonl(ip);
-
-    in_addr addr;
-    addr.s_addr = net_ip;
+std::vector<uint32_t> Capture::seenIps() const {
+    return m_classifier.seenIps();
+}
 
-    char buf[INET_ADDRSTRLEN];
-    if (inet_ntop(AF_INET, &addr, buf, sizeof(buf)) != nullptr) {
-        return buf;
-    } else {
-        std::perror("inet_ntop");
-        return "error occured";
-    }
+// Hands a copy of the seen-set to the tracker for a warm-start snapshot once
+// the configured interval has passed. Only called when a new destination was
+// added, so an unchanged set is never snapshotted again. Replayed and
+// generated traffic is never snapshotted
+void Capture::maybeSnapshot() {
+    const uint16_t interval = m_ipTracker->pSettings->getSnapshotInterval();
+    if (interval == 0 || !isLive())
+        return;
+    const auto now = std::chrono::steady_clock::now();
+    if (now < m_nextSnapshot)
+        return;
+    m_nextSnapshot = now + std::chrono::seconds(interval);
+    m_ipTracker->snapshotWarmState(seenIps());
 }
 
 bool Capture::packetHandler(const PDU& pdu) {
-    if (!pdu.find_pdu<IP>())
-        return true;
-
-    uint32_t dst_ip_uint = pdu.rfind_pdu<IP>().dst_addr();
-
-    if (!isKnown(dst_ip_uint)) {
-        addIp(dst_ip_uint);
-        m_ipTracker->enqueueIp(dst_ip_uint);
-        if (m_ipTracker->pSettings->hasVerbose()) {
-            std::string decodedIP = decodeIP(dst_ip_uint);
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Added '" + decodedIP +
-                                          "' IP to the cache");
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Pushed '" + decodedIP +
-                                          "' to the IP Queue");
-        }
+    m_packets.inc();
+    // read per packet so the setting applies at once
+    const classifiedPacket packet = m_classifier.classify(
+        pdu, m_ipTracker->pSettings->getPrioritizeTraffic());
+
+    if (packet.action == PacketAction::ENQUEUE) {
+        const int64_t seenNs = Clock::monotonicNs();
+        m_newDestinations.inc();
+        m_ipTracker->enqueueIp(packet.ip, seenNs, packet.priority);
+        LOG_DEBUG("Added '{}' IP to the cache and pushed it to the IP Queue",
+                  decodeIP(packet.ip));
+        maybeSnapshot();
+    } else if (packet.action == PacketAction::PROMOTE) {
+        m_ipTracker->promoteIp(packet.ip, packet.priority);
     }
     return true;
 }
 
+void Capture::setReplay(const std::string& path, double speed) {
+    m_replayPath = path;
+    m_replaySpeed = speed;
+}
+
+void Capture::setSynthetic(double rate, size_t destinations) {
+    m_syntheticRate = rate;
+    m_syntheticDestinations = destinations;
+}
+
 void Capture::startCapture() {
+    m_classifier.resetTraffic();
+
+    if (m_syntheticDestinations > 0) {
+        m_stopSource.store(false);
+        m_captureThread = std::thread(&Capture::generateLoop, this);
+        return;
+    }
+
+    if (!m_replayPath.empty()) {
+        try {
+            Tins::SnifferConfiguration config;
+            config.set_filter(m_ipTracker->pSettings->getFilter());
+            m_pSniffer =
+                std::make_unique<FileSniffer>(m_replayPath, config);
+            if (m_replaySpeed > 0)
+                LOG_INFO("Replaying '{}' at {}x", m_replayPath, m_replaySpeed);
+            else
+                LOG_INFO("Replaying '{}' as fast as possible", m_replayPath);
+        } catch (const std::exception& e) {
+            Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                      "Error opening capture file: " +
+                                          std::string(e.what()));
+            return;
+        }
+        m_stopSource.store(false);
+        m_captureThread = std::thread(&Capture::replayLoop, this);
+        return;
+    }
+
     std::string interfaceOption = m_ipTracker->pSettings->getInterfaceOption();
     // use the correct network interface depending on settings' saved option
     std::string interface =
@@ -74,11 +120,11 @@ void Capture::startCapture() {
 
         m_pSniffer = std::make_unique<Sniffer>(interface, config);
 
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Created sniffer object for the '" +
-                                          interface + "' interface");
+        LOG_DEBUG("Created sniffer object for the '{}' interface", interface);
 
+        const uint16_t interval = m_ipTracker->pSettings->getSnapshotInterval();
+        m_nextSnapshot =
+            std::chrono::steady_clock::now() + std::chrono::seconds(interval);
         m_captureThread = std::thread(&Capture::captureLoop, this);
     } catch (const std::exception& e) {
         Logger::getInstance().log(LogLevel::ERROR, __func__,
@@ -88,16 +134,13 @@ void Capture::startCapture() {
 }
 
 void Capture::stopCapture() {
-    if (m_pSniffer) {
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Stopping sniffer object");
+    m_stopSource.store(true);
+    if (m_pSniffer && isLive()) {
+        LOG_DEBUG("Stopping sniffer object");
         // notify the sniffer object to stop sniffing
         m_pSniffer->stop_sniff();
     }
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Attempting to join the capture thread");
+    LOG_DEBUG("Attempting to join the capture thread");
     if (m_captureThread.joinable())
         m_captureThread.join();
 
@@ -105,9 +148,7 @@ void Capture::stopCapture() {
 }
 
 void Capture::captureLoop() {
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Thread is initialising the captureLoop");
+    LOG_DEBUG("Thread is initialising the captureLoop");
     try {
         m_pSniffer->sniff_loop(
             [this](const Tins::PDU& pdu) { return packetHandler(pdu); });
@@ -117,3 +158,110 @@ void Capture::captureLoop() {
                                       std::string(e.what()));
     }
 }
+
+// Feeds the packets of the replay file through packetHandler(). With a speed
+// set, each packet is held back until its original offset from the first one,
+// divided by the speed, has passed
+void Capture::replayLoop() {
+    using namespace std::chrono;
+    const steady_clock::time_point start = steady_clock::now();
+    microseconds firstTs{-1};
+    uint64_t packets = 0;
+
+    try {
+        while (!m_stopSource.load()) {
+            Packet packet = m_pSniffer->next_packet();
+            if (!packet.pdu())
+                break;  // end of file
+
+            if (m_replaySpeed > 0) {
+                const microseconds ts = packet.timestamp();
+                if (firstTs.count() < 0)
+                    firstTs = ts;
+                const steady_clock::time_point due =
+                    start + duration_cast<steady_clock::duration>(
+                                (ts - firstTs) / m_replaySpeed);
+                // sleep in slices so stopCapture() is not held up by a gap
+                // in the capture
+                for (auto now = steady_clock::now();
+                     now < due && !m_stopSource.load();
+                     now = steady_clock::now())
+                    std::this_thread::sleep_for(
+                        std::min<steady_clock::duration>(due - now,
+                                                         milliseconds(100)));
+            }
+
+            packetHandler(*packet.pdu());
+            ++packets;
+        }
+    } catch (const std::exception& e) {
+        Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                  "Error reading capture file: " +
+                                      std::string(e.what()));
+    }
+
+    const double seconds =
+        duration<double>(steady_clock::now() - start).count();
+    LOG_INFO("Replayed {} packets from '{}' in {} s, {} packets/s", packets,
+             m_replayPath, seconds,
+             seconds > 0 ? static_cast<uint64_t>(packets / seconds) : 0);
+}
+
+// a random address outside the private, loopback, multicast and reserved
+// ranges the default filter excludes
+static uint32_t randomPublicIp(std::mt19937& rng) {
+    for (;;) {
+        const uint32_t ip = rng();
+        const uint32_t first = ip >> 24;
+        if (first == 0 || first == 10 || first == 127 || first >= 224 ||
+            (ip & 0xFFF00000) == 0xAC100000 ||  // 172.16.0.0/12
+            (ip & 0xFFFF0000) == 0xC0A80000)    // 192.168.0.0/16
+            continue;
+        return ip;
+    }
+}
+
+// Load generator: feeds packets to destinations drawn uniformly from a fixed
+// pool through packetHandler(). Once the pool has been covered most packets
+// take the already-seen path, as live traffic does. The same seed is used
+// on every run, so runs with the same pool size see the same destinations
+void Capture::generateLoop() {
+    using namespace std::chrono;
+    std::mt19937 rng(1);
+    std::vector<uint32_t> pool(m_syntheticDestinations);
+    for (uint32_t& ip : pool)
+        ip = randomPublicIp(rng);
+    std::uniform_int_distribution<size_t> pick(0, pool.size() - 1);
+
+    if (m_syntheticRate > 0)
+        LOG_INFO("Generating {} packets/s to {} destinations", m_syntheticRate,
+                 pool.size());
+    else
+        LOG_INFO("Generating packets to {} destinations as fast as possible",
+                 pool.size());
+
+    const steady_clock::time_point start = steady_clock::now();
+    uint64_t packets = 0;
+    while (!m_stopSource.load()) {
+        if (m_syntheticRate > 0) {
+            // only sleep once more than a millisecond ahead, so high rates
+            // are sent in small bursts rather than a sleep per packet
+            const steady_clock::time_point due =
+                start + duration_cast<steady_clock::duration>(
+                            duration<double>(packets / m_syntheticRate));
+            const steady_clock::time_point now = steady_clock::now();
+            if (due - now > milliseconds(1)) {
+                std::this_thread::sleep_for(std::min<steady_clock::duration>(
+                    due - now, milliseconds(100)));
+                continue;
+            }
+        }
+        packetHandler(IP(IPv4Address(pool[pick(rng)])));
+        ++packets;
+    }
+
+    const double seconds =
+        duration<double>(steady_clock::now() - start).count();
+    LOG_INFO("Generated {} packets in {} s, {} packets/s", packets, seconds,
+             seconds > 0 ? static_cast<uint64_t>(packets / seconds) : 0);
+}
@@ -1,7 +1,12 @@
 #pragma once
+#include "capture/classifier/classifier.hpp"
+#include "metrics/metrics.hpp"
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <thread>
-#include <unordered_set>
+#include <string>
+#include <vector>
 #include <tins/tins.h>
 
 class IpTracker;
@@ -11,14 +16,40 @@ class Capture {
         Capture(IpTracker* ipTracker);
         void startCapture();
         void stopCapture();
+        // seeds the seen-set with destinations from a previous run, call
+        // before startCapture()
+        void restoreSeen(const std::vector<uint32_t>& ips);
+        // copy of the seen-set, only call while the capture is stopped
+        std::vector<uint32_t> seenIps() const;
+        // read packets from a pcap/pcapng file instead of the interface.
+        // speed scales the original timing, 2 replays twice as fast and 0
+        // as fast as possible. Call before startCapture()
+        void setReplay(const std::string& path, double speed);
+        // generate packets to a fixed pool of random public destinations
+        // instead, rate packets per second or as fast as possible for 0. Call
+        // before startCapture()
+        void setSynthetic(double rate, size_t destinations);
 
     private:
         std::thread m_captureThread;
-        std::unique_ptr<Tins::Sniffer> m_pSniffer;
+        std::unique_ptr<Tins::BaseSniffer> m_pSniffer;
         IpTracker* m_ipTracker;
-        inline bool isKnown(const uint32_t& ip);
-        inline void addIp(const uint32_t& ip);
+        std::string m_replayPath;  // empty unless replaying a file
+        double m_replaySpeed = 0;
+        size_t m_syntheticDestinations = 0;  // 0 unless generating traffic
+        double m_syntheticRate = 0;
+        // stops the replay and generator loops, the sniffer has stop_sniff()
+        std::atomic<bool> m_stopSource{false};
+        bool isLive() const {
+            return m_replayPath.empty() && m_syntheticDestinations == 0;
+        }
+        void replayLoop();
+        void generateLoop();
         void captureLoop();
-        std::unordered_set<std::uint32_t> m_ipCache;
+        void maybeSnapshot();
+        PacketClassifier m_classifier;
+        std::chrono::steady_clock::time_point m_nextSnapshot;
+        Counter& m_packets;
+        Counter& m_newDestinations;
         bool packetHandler(const Tins::PDU& pdu);
 };
@@ -0,0 +1,48 @@
+#include "classifier.hpp"
+
+using namespace Tins;
+
+classifiedPacket PacketClassifier::classify(const PDU& pdu, bool prioritize) {
+    classifiedPacket packet;
+    if (!pdu.find_pdu<IP>())
+        return packet;
+
+    const IP& ip = pdu.rfind_pdu<IP>();
+    packet.ip = ip.dst_addr();
+
+    bool crossed = false;
+    if (prioritize != m_prioritize) {
+        m_prioritize = prioritize;
+        m_traffic.clear();
+    }
+    if (prioritize) {
+        const uint32_t size = ip.tot_len();
+        packet.priority = m_traffic.add(packet.ip, size).bytes;
+        // the highest set bit moved up, the traffic doubled since the
+        // last promotion
+        const uint64_t before = packet.priority - size;
+        crossed = (before ^ packet.priority) > before;
+    }
+
+    if (m_seen.insert(packet.ip).second)
+        packet.action = PacketAction::ENQUEUE;
+    else if (crossed)
+        // only on every doubling, so a busy destination does not take the
+        // queue lock for each of its packets
+        packet.action = PacketAction::PROMOTE;
+    return packet;
+}
+
+void PacketClassifier::resetTraffic() {
+    m_prioritize = false;
+    m_traffic.clear();
+}
+
+void PacketClassifier::restoreSeen(const std::vector<uint32_t>& ips) {
+    m_seen.reserve(m_seen.size() + ips.size());
+    m_seen.insert(ips.begin(), ips.end());
+}
+
+std::vector<uint32_t> PacketClassifier::seenIps() const {
+    return std::vector<uint32_t>(m_seen.begin(), m_seen.end());
+}
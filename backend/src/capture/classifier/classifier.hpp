@@ -0,0 +1,36 @@
+#pragma once
+#include "utils/traffic_sketch/traffic_sketch.hpp"
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+#include <tins/tins.h>
+
+// what the capture has to do about a packet
+enum class PacketAction { NONE, ENQUEUE, PROMOTE };
+
+struct classifiedPacket {
+        PacketAction action = PacketAction::NONE;
+        uint32_t ip = 0;  // destination, for ENQUEUE and PROMOTE
+        // bytes sent to ip recently, 0 without prioritization
+        uint64_t priority = 0;
+};
+
+// Keeps the seen-set and the recent traffic of every destination, and tells
+// for each captured packet whether its destination is new and has to be
+// queued, or is already queued and earned a promotion. Not thread-safe, it
+// belongs to the capture thread
+class PacketClassifier {
+    public:
+        // prioritize is the prioritizeTraffic setting, counting restarts
+        // from scratch whenever it is turned back on
+        classifiedPacket classify(const Tins::PDU& pdu, bool prioritize);
+        // forgets the traffic counted so far, the seen-set is kept
+        void resetTraffic();
+        void restoreSeen(const std::vector<uint32_t>& ips);
+        std::vector<uint32_t> seenIps() const;
+
+    private:
+        std::unordered_set<uint32_t> m_seen;
+        TrafficSketch m_traffic;
+        bool m_prioritize = false;  // the setting as of the last packet
+};
@@ -0,0 +1,192 @@
+#include "history.hpp"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <queue>
+
+// how far back add() looks for a result's place in the time log
+constexpr size_t MAX_TIME_WALK = 256;
+
+void TraceHistory::seqList::popFront() {
+    ++head;
+    // compact once most of the vector is dead space
+    if (head > 32 && head * 2 > seqs.size()) {
+        seqs.erase(seqs.begin(), seqs.begin() + head);
+        head = 0;
+    }
+}
+
+void TraceHistory::setCapacity(size_t capacity) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_capacity = std::max<size_t>(1, capacity);
+    while (m_records.size() > m_capacity)
+        evictOldest();
+}
+
+size_t TraceHistory::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_records.size();
+}
+
+bool TraceHistory::contains(uint32_t ip) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_byIp.find(ip) != m_byIp.end();
+}
+
+const traceResult& TraceHistory::at(uint64_t seq) const {
+    return m_records[seq - m_firstSeq];
+}
+
+void TraceHistory::add(const traceResult& result) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    while (m_records.size() >= m_capacity)
+        evictOldest();
+
+    const uint64_t seq = m_firstSeq + m_records.size();
+    m_records.push_back(result);
+
+    const destInfo& d = result.dest_info;
+    m_byIp[d.ip].seqs.push_back(seq);
+    if (d.asn)
+        m_byAsn[d.asn].seqs.push_back(seq);
+    if (d.country)
+        m_byCountry[d.country].seqs.push_back(seq);
+
+    // lookup threads finish out of order, but only slightly, so the insert
+    // position is found by walking back from the end. A result further out
+    // of place means the wall clock stepped back, it is logged under the
+    // newest timestamp rather than paying for a long walk and insert
+    auto pos = m_byTime.end();
+    const int64_t timestamp = result.timestampMs();
+    size_t steps = 0;
+    while (pos != m_byTime.begin() && std::prev(pos)->first > timestamp &&
+           steps < MAX_TIME_WALK) {
+        --pos;
+        ++steps;
+    }
+    if (pos != m_byTime.begin() && std::prev(pos)->first > timestamp)
+        m_byTime.emplace_back(m_byTime.back().first, seq);
+    else
+        m_byTime.insert(pos, {timestamp, seq});
+}
+
+// removes the oldest record from the store and every index
+void TraceHistory::evictOldest() {
+    if (m_records.empty())
+        return;
+
+    const destInfo& d = m_records.front().dest_info;
+    auto popIndex = [](auto& index, auto key) {
+        auto it = index.find(key);
+        if (it == index.end())
+            return;
+        it->second.popFront();
+        if (it->second.size() == 0)
+            index.erase(it);
+    };
+    popIndex(m_byIp, d.ip);
+    if (d.asn)
+        popIndex(m_byAsn, d.asn);
+    if (d.country)
+        popIndex(m_byCountry, d.country);
+
+    m_records.pop_front();
+    ++m_firstSeq;
+    while (!m_byTime.empty() && m_byTime.front().second < m_firstSeq)
+        m_byTime.pop_front();
+}
+
+bool TraceHistory::matches(const historyQuery& query,
+                           const traceResult& result) {
+    const destInfo& d = result.dest_info;
+    return (!query.hasIp || d.ip == query.ip) &&
+           (!query.hasCidr || (d.ip & query.mask) == query.network) &&
+           (!query.hasAsn || d.asn == query.asn) &&
+           (!query.hasCountry || d.country == query.country) &&
+           result.timestampMs() >= query.from &&
+           result.timestampMs() <= query.to;
+}
+
+std::vector<traceResult> TraceHistory::query(const historyQuery& query) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<traceResult> out;
+    if (query.limit == 0)
+        return out;
+
+    // returns false once the limit is reached
+    auto visit = [&](uint64_t seq) {
+        if (seq < m_firstSeq)
+            return true;
+        const traceResult& result = at(seq);
+        if (matches(query, result))
+            out.push_back(result);
+        return out.size() < query.limit;
+    };
+
+    // drive the query from the smallest candidate list available
+    const seqList* best = nullptr;
+    bool emptyIndex = false;
+    auto consider = [&](const auto& index, auto key) {
+        auto it = index.find(key);
+        if (it == index.end())
+            emptyIndex = true;
+        else if (!best || it->second.size() < best->size())
+            best = &it->second;
+    };
+    if (query.hasIp)
+        consider(m_byIp, query.ip);
+    if (query.hasAsn)
+        consider(m_byAsn, query.asn);
+    if (query.hasCountry)
+        consider(m_byCountry, query.country);
+    if (emptyIndex)
+        return out;
+
+    if (best) {
+        for (size_t i = best->seqs.size(); i > best->head; --i)
+            if (!visit(best->seqs[i - 1]))
+                break;
+    } else if (query.hasCidr) {
+        // addresses inside the prefix form one contiguous range of the map.
+        // Each address's list is walked newest first into a min-heap that
+        // keeps the limit newest matches, and left as soon as the rest of it
+        // is older than all of them
+        std::priority_queue<uint64_t, std::vector<uint64_t>,
+                            std::greater<uint64_t>>
+            newest;
+        auto first = m_byIp.lower_bound(query.network);
+        auto last = m_byIp.upper_bound(query.network | ~query.mask);
+        for (auto it = first; it != last; ++it) {
+            const seqList& list = it->second;
+            for (size_t i = list.seqs.size(); i > list.head; --i) {
+                uint64_t seq = list.seqs[i - 1];
+                if (newest.size() == query.limit && seq < newest.top())
+                    break;
+                if (!matches(query, at(seq)))
+                    continue;
+                newest.push(seq);
+                if (newest.size() > query.limit)
+                    newest.pop();
+            }
+        }
+        out.resize(newest.size());
+        for (size_t i = out.size(); i > 0; --i) {
+            out[i - 1] = at(newest.top());
+            newest.pop();
+        }
+    } else {
+        // time range only, walk the log backwards from the end of the range
+        auto end = std::upper_bound(
+            m_byTime.begin(), m_byTime.end(), query.to,
+            [](int64_t to, const auto& entry) { return to < entry.first; });
+        for (auto it = end; it != m_byTime.begin();) {
+            --it;
+            if (it->first < query.from)
+                break;
+            if (!visit(it->second))
+                break;
+        }
+    }
+    return out;
+}
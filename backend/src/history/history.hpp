@@ -0,0 +1,73 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// criteria for TraceHistory::query(), every field that is set has to match
+struct historyQuery {
+        bool hasIp = false;
+        uint32_t ip = 0;
+        bool hasCidr = false;
+        uint32_t network = 0, mask = 0;
+        bool hasAsn = false;
+        uint32_t asn = 0;
+        bool hasCountry = false;
+        stringId country = 0;
+        int64_t from = 0;  // unix epoch ms, inclusive
+        int64_t to = std::numeric_limits<int64_t>::max();
+        size_t limit = 1000;
+};
+
+// Bounded in-memory store of recent results with secondary indexes, so that
+// queries by address, prefix, ASN, country or time range only visit matching
+// records:
+//  - an ordered map by destination address, serving exact and CIDR lookups
+//    as a range scan
+//  - hash indexes by AS number and country id
+//  - a time-ordered log of (timestamp in ms, sequence) pairs
+// Records are identified by an increasing sequence number and evicted oldest
+// first once the configured capacity is reached.
+class TraceHistory {
+    public:
+        void setCapacity(size_t capacity);
+        void add(const traceResult& result);
+        // matching results, newest first, at most query.limit of them
+        std::vector<traceResult> query(const historyQuery& query) const;
+        // true while a result for ip is retained
+        bool contains(uint32_t ip) const;
+        size_t size() const;
+
+    private:
+        // ascending sequence numbers, popped from the front on eviction
+        struct seqList {
+                std::vector<uint64_t> seqs;
+                size_t head = 0;
+
+                size_t size() const { return seqs.size() - head; }
+                void popFront();
+        };
+
+        void evictOldest();
+        const traceResult& at(uint64_t seq) const;
+        static bool matches(const historyQuery& query,
+                            const traceResult& result);
+
+        mutable std::shared_mutex m_mutex;
+        size_t m_capacity = 100000;
+        std::deque<traceResult> m_records;  // m_records[seq - m_firstSeq]
+        uint64_t m_firstSeq = 0;
+
+        std::map<uint32_t, seqList> m_byIp;
+        std::unordered_map<uint32_t, seqList> m_byAsn;
+        std::unordered_map<stringId, seqList> m_byCountry;
+        // sorted by timestamp, may hold entries for evicted records which are
+        // skipped and pruned from the front. A result that arrived far out of
+        // order is filed under the timestamp of the one before it
+        std::deque<std::pair<int64_t, uint64_t>> m_byTime;
+};
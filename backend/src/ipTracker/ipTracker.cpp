@@ -1,100 +1,214 @@
 #include "ipTracker.hpp"
+#include "utils/clock/clock.hpp"
 #include "utils/logger/logger.hpp"
+#include "utils/settings/settings_utils/settings.hpp"
+#include <algorithm>
+#include <filesystem>
 #include <curl/curl.h>
 
 IpTracker::IpTracker()
     : pSettings(Settings::loadFromFile()),
       m_capture(this),
       m_lookup(this),
-      m_api(this) {}
+      m_api(this),
+      m_resultsDropped(Metrics::getInstance().counter(
+          "hovia_results_dropped_total",
+          "Results dropped from a full backlog while no client was "
+          "connected")),
+      m_promotions(Metrics::getInstance().counter(
+          "hovia_ip_promotions_total",
+          "Queued destinations moved up by the traffic sent to them")) {
+    Logger::getInstance().configure(pSettings);
+    m_history.setCapacity(pSettings->getHistorySize());
+
+    Metrics& metrics = Metrics::getInstance();
+    metrics.gauge("hovia_ip_queue_depth", "Destinations waiting to be traced",
+                  [this]() { return static_cast<double>(ipQueueDepth()); });
+    metrics.gauge("hovia_result_queue_depth",
+                  "Results waiting to be sent to websocket clients", [this]() {
+                      std::lock_guard<std::mutex> lock(m_resultsQueueMutex);
+                      return static_cast<double>(m_resultsQueue.size());
+                  });
+    metrics.gauge("hovia_history_size", "Results held by the trace history",
+                  [this]() { return static_cast<double>(m_history.size()); });
+}
 
 void IpTracker::saveSettings() { pSettings->saveToFile(); }
 
-void IpTracker::enqueueIp(const uint32_t ip) {
-    {
-        std::lock_guard<std::mutex> lock(m_ipQueueMutex);
-        m_ipQueue.push(ip);
-    }
-    m_ipQueueCond.notify_one();
+void IpTracker::enqueueIp(const uint32_t ip, int64_t seenNs,
+                          uint64_t priority) {
+    m_ipQueue.push(ip, seenNs, priority);
 }
 
-// Dequeue IP, making sure
-bool IpTracker::dequeueIp(uint32_t &ip) {
-    std::unique_lock<std::mutex> lock(m_ipQueueMutex);
-    // temporarily releases its lock, until m_ipQueue has an entry, or
-    // m_hasStopped is set off, meaning the app must shutdown
-    m_ipQueueCond.wait(lock,
-                       [this]() { return !m_ipQueue.empty() || m_hasStopped; });
-
-    if (m_hasStopped)
-        return false;
+void IpTracker::promoteIp(const uint32_t ip, uint64_t priority) {
+    if (m_ipQueue.promote(ip, priority))
+        m_promotions.inc();
+}
 
-    ip = m_ipQueue.front();
-    m_ipQueue.pop();
-    return true;
+DequeueResult IpTracker::dequeueIp(uint32_t &ip, pipelineTimeline &timeline,
+                                   std::chrono::milliseconds timeout) {
+    return m_ipQueue.pop(ip, timeline, timeout);
 }
 
-void IpTracker::enqueueResult(const traceResult &Result) {
+size_t IpTracker::ipQueueDepth() { return m_ipQueue.size(); }
+
+// Record a finished result in the history and journal, queue it and let the
+// API know there is something to send. Results wait here while no websocket
+// client is attached, once the backlog reaches its configured size the oldest
+// one is dropped
+void IpTracker::enqueueResult(traceResult &&Result,
+                              pipelineTimeline timeline) {
+    timeline.resultQueued = Clock::monotonicNs();
+    m_history.add(Result);
+    m_journal.append(Result);
+
+    bool dropped = false;
     {
         std::lock_guard<std::mutex> lock(m_resultsQueueMutex);
-        m_resultsQueue.push(Result);
+        const size_t backlog =
+            std::max<size_t>(1, pSettings->getResultBacklog());
+        while (m_resultsQueue.size() >= backlog) {
+            m_resultsQueue.pop();
+            m_resultsDropped.inc();
+            dropped = true;
+        }
+        m_resultsQueue.emplace(std::move(Result), timeline);
     }
-    m_resultsQueueCond.notify_one();
+    // only reported in verbose mode, this repeats for every result while
+    // nobody is connected
+    if (dropped && pSettings->hasVerbose())
+        LOG_WARNING("Result backlog full, dropped the oldest result");
+    m_api.notifyResults();
 }
 
-bool IpTracker::dequeueResult(traceResult &Result) {
-    std::unique_lock<std::mutex> lock(m_resultsQueueMutex);
-    // temporarily releases its lock, until m_resultsQueue has an entry, or
-    // m_hasStopped is set off, meaning the app must shutdown
-    m_resultsQueueCond.wait(
-        lock, [this]() { return !m_resultsQueue.empty() || m_hasStopped; });
-
+// Moves up to maxCount queued results onto the end of Results, and their
+// timelines onto the end of Timelines, without blocking. Returns the number
+// of results moved, 0 if the queue was empty or the app is shutting down
+size_t IpTracker::tryDequeueResults(std::vector<traceResult> &Results,
+                                    std::vector<pipelineTimeline> &Timelines,
+                                    size_t maxCount) {
+    std::lock_guard<std::mutex> lock(m_resultsQueueMutex);
     if (m_hasStopped)
-        return false;
+        return 0;
+
+    size_t count = 0;
+    while (count < maxCount && !m_resultsQueue.empty()) {
+        Results.push_back(std::move(m_resultsQueue.front().first));
+        Timelines.push_back(m_resultsQueue.front().second);
+        m_resultsQueue.pop();
+        ++count;
+    }
+    return count;
+}
+
+std::string IpTracker::warmStatePath() const {
+    return (std::filesystem::path(getConfigPath()) / "warm_start.bin")
+        .string();
+}
 
-    Result = m_resultsQueue.front();
-    m_resultsQueue.pop();
-    return true;
+void IpTracker::snapshotWarmState(std::vector<uint32_t> &&seen) {
+    if (m_offline)
+        return;
+    if (m_snapshotWrite.valid() &&
+        m_snapshotWrite.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+        return;
+
+    warmState state;
+    state.seen = std::move(seen);
+    state.pending = m_ipQueue.pending();
+    m_snapshotWrite = std::async(
+        std::launch::async, [this, state = std::move(state)]() {
+            if (!saveWarmState(warmStatePath(), state))
+                Logger::getInstance().log(LogLevel::ERROR, "snapshotWarmState",
+                                          "Failed to write the warm-start "
+                                          "snapshot");
+        });
 }
 
 // Call the capture, lookup and api objects' start() functions, in order for
 // each one to spawn their respective number of threads and begin performing
 // their operations
 void IpTracker::start() {
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling startCapture()");
+    // reload the history persisted by previous runs before anything new
+    // arrives, then keep journaling. Offline runs neither read nor write the
+    // journal, so they all start from an empty history and leave nothing
+    // behind for the next live run
+    const uint16_t segments = pSettings->getJournalSegments();
+    const std::string journalDir =
+        (std::filesystem::path(getConfigPath()) / "journal").string();
+    if (!m_offline && segments > 0 && m_journal.open(journalDir, segments)) {
+        size_t restored = m_journal.replay(
+            [this](traceResult &&result) { m_history.add(result); });
+        LOG_DEBUG("Restored {} results from the journal at {}", restored,
+                  journalDir);
+        m_journal.start();
+    }
+
+    // the newest restored results are replayed to dashboards that connect
+    // before anything new is traced
+    historyQuery recent;
+    recent.limit = pSettings->getReplaySize();
+    std::vector<traceResult> replay = m_history.query(recent);
+    std::reverse(replay.begin(), replay.end());
+    m_api.seedReplay(replay);
+
+    // destinations traced by the previous run are not traced again as long
+    // as their result is still in the history, so a route that was evicted
+    // is traced anew and the seen-set never outgrows the history. Those the
+    // previous run had not got to yet are queued again in the order it
+    // would have traced them
+    warmState state;
+    if (!m_offline && loadWarmState(warmStatePath(), state)) {
+        const size_t saved = state.seen.size();
+        state.seen.erase(std::remove_if(state.seen.begin(), state.seen.end(),
+                                        [this](uint32_t ip) {
+                                            return !m_history.contains(ip);
+                                        }),
+                         state.seen.end());
+        m_capture.restoreSeen(state.seen);
+        for (uint32_t ip : state.pending)
+            enqueueIp(ip);
+        LOG_DEBUG("Warm start: {} of {} known destinations still in the "
+                  "history, {} pending",
+                  state.seen.size(), saved, state.pending.size());
+    }
+
+    LOG_DEBUG("Calling startCapture()");
     m_capture.startCapture();
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling startLookup()");
+    LOG_DEBUG("Calling startLookup()");
     m_lookup.startLookup();
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling startAPI()");
+    LOG_DEBUG("Calling startAPI()");
     m_api.startAPI();
 }
 
 // Notify all threads to stop and shutdown any operation
 void IpTracker::stop() {
     {
-        std::lock_guard<std::mutex> lock1(m_ipQueueMutex);
-        std::lock_guard<std::mutex> lock2(m_resultsQueueMutex);
+        std::lock_guard<std::mutex> lock(m_resultsQueueMutex);
         m_hasStopped = true;
     }
-    m_ipQueueCond.notify_all();
-    m_resultsQueueCond.notify_all();
+    m_ipQueue.stop();
 
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling stopCapture()");
+    LOG_DEBUG("Calling stopCapture()");
     m_capture.stopCapture();
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling stopLookup()");
+    LOG_DEBUG("Calling stopLookup()");
     m_lookup.stopLookup();
-    if (pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Calling stopAPI()");
+    // lookups are done, flush the results they journaled
+    m_journal.stop();
+
+    // the capture is stopped, so its seen-set can be read directly
+    if (m_snapshotWrite.valid())
+        m_snapshotWrite.wait();
+    if (!m_offline) {
+        warmState state;
+        state.seen = m_capture.seenIps();
+        state.pending = m_ipQueue.pending();
+        if (!saveWarmState(warmStatePath(), state))
+            Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                      "Failed to write the warm-start "
+                                      "snapshot");
+    }
+    LOG_DEBUG("Calling stopAPI()");
     m_api.stopAPI();
 }
@@ -2,32 +2,82 @@
 #include "capture/capture.hpp"
 #include "lookup/lookup.hpp"
 #include "api/api.hpp"
+#include "history/history.hpp"
+#include "ipTracker/ip_queue/ip_queue.hpp"
+#include "journal/journal.hpp"
+#include "metrics/metrics.hpp"
+#include "simulator/simulator.hpp"
 #include "utils/common_structs.hpp"
 #include "utils/settings/settings.hpp"
-#include <condition_variable>
+#include "warm_start/warm_start.hpp"
+#include <chrono>
+#include <future>
 #include <memory>
 #include <queue>
 #include <mutex>
+#include <utility>
 
 class IpTracker {
     public:
         IpTracker();
         std::shared_ptr<Settings> pSettings;
         void saveSettings();
-        void enqueueIp(const uint32_t ip);
-        bool dequeueIp(uint32_t& ip);
-        void enqueueResult(const traceResult& Result);
-        bool dequeueResult(traceResult& Result);
+        // queue ip for a lookup thread, see IpQueue::push()
+        void enqueueIp(const uint32_t ip, int64_t seenNs = 0,
+                       uint64_t priority = 0);
+        // raises the priority of ip if it is still queued
+        void promoteIp(const uint32_t ip, uint64_t priority);
+        // waits up to timeout for a destination, filling in the queue stages
+        // of timeline along with it
+        DequeueResult dequeueIp(uint32_t& ip, pipelineTimeline& timeline,
+                                std::chrono::milliseconds timeout);
+        size_t ipQueueDepth();
+        void enqueueResult(traceResult&& Result, pipelineTimeline timeline);
+        size_t tryDequeueResults(std::vector<traceResult>& Results,
+                                 std::vector<pipelineTimeline>& Timelines,
+                                 size_t maxCount);
         void start();
         void stop();
+        // drive the pipeline from a capture file or the load generator,
+        // see Capture::setReplay() and setSynthetic(). Such runs, and those
+        // against the simulator, neither restore nor save the warm-start
+        // state or the journal, so they all start out alike
+        void setReplay(const std::string& path, double speed) {
+            m_capture.setReplay(path, speed);
+            m_offline = true;
+        }
+        void setSynthetic(double rate, size_t destinations) {
+            m_capture.setSynthetic(rate, destinations);
+            m_offline = true;
+        }
+        // trace and look up against the simulated network. Its made up
+        // routes must not end up in the warm-start state of real runs
+        void setSimulation(const simConfig& config) {
+            m_lookup.setBackends(std::make_unique<SimulatedTrace>(config),
+                                 std::make_unique<SimulatedGeo>(config));
+            m_offline = true;
+        }
+        const TraceHistory& getHistory() const { return m_history; }
+        void resizeHistory(size_t capacity) { m_history.setCapacity(capacity); }
+        // writes a warm-start snapshot with the given seen-set in the
+        // background, skipped while the previous one is still being written
+        void snapshotWarmState(std::vector<uint32_t>&& seen);
 
     private:
         Capture m_capture;
         Lookup m_lookup;
         ApiServer m_api;
+        TraceHistory m_history;
+        TraceJournal m_journal;
+        std::future<void> m_snapshotWrite;
+        std::string warmStatePath() const;
         bool m_hasStopped = false;
-        std::queue<uint32_t> m_ipQueue;
-        std::queue<traceResult> m_resultsQueue;
-        std::mutex m_ipQueueMutex, m_resultsQueueMutex;
-        std::condition_variable m_ipQueueCond, m_resultsQueueCond;
+        // replaying, generating or simulating, so nothing is persisted
+        bool m_offline = false;
+        IpQueue m_ipQueue;
+        // results waiting for the API, each with its timeline
+        std::queue<std::pair<traceResult, pipelineTimeline>> m_resultsQueue;
+        std::mutex m_resultsQueueMutex;
+        Counter& m_resultsDropped;
+        Counter& m_promotions;
 };
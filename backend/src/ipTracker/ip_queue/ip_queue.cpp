@@ -0,0 +1,106 @@
+#include "ip_queue.hpp"
+#include "utils/clock/clock.hpp"
+#include <algorithm>
+
+int64_t IpQueue::rankFor(uint64_t priority, int64_t enqueuedNs) {
+    int64_t bits = 0;
+    for (; priority != 0; priority >>= 1)
+        ++bits;
+    return bits * AGE_STEP_NS - enqueuedNs;
+}
+
+void IpQueue::push(uint32_t ip, int64_t seenNs, uint64_t priority) {
+    const int64_t now = Clock::monotonicNs();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto [it, added] = m_queued.try_emplace(ip);
+        if (!added) {
+            // already waiting, only its priority can change
+            const int64_t rank = rankFor(priority, it->second.enqueuedNs);
+            if (rank > it->second.rank) {
+                it->second.rank = rank;
+                m_heap.push({rank, it->second.seq, ip});
+            }
+            return;
+        }
+        it->second = {seenNs, now, rankFor(priority, now), m_nextSeq++};
+        m_heap.push({it->second.rank, it->second.seq, ip});
+    }
+    m_cond.notify_one();
+}
+
+bool IpQueue::promote(uint32_t ip, uint64_t priority) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_queued.find(ip);
+    if (it == m_queued.end())
+        return false;
+    const int64_t rank = rankFor(priority, it->second.enqueuedNs);
+    if (rank <= it->second.rank)
+        return false;
+    it->second.rank = rank;
+    m_heap.push({rank, it->second.seq, ip});
+    return true;
+}
+
+DequeueResult IpQueue::pop(uint32_t& ip, pipelineTimeline& timeline,
+                           std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // temporarily releases its lock, until m_queued has an entry, or
+    // m_stopped is set, meaning the app must shutdown
+    const bool woken = m_cond.wait_for(lock, timeout, [this]() {
+        return !m_queued.empty() || m_stopped;
+    });
+
+    if (m_stopped)
+        return DequeueResult::STOPPED;
+    if (!woken)
+        return DequeueResult::TIMEOUT;
+
+    // skip the entries left behind by promotions, the live entry of every
+    // queued destination is still in the heap
+    for (;;) {
+        const rankedIp top = m_heap.top();
+        m_heap.pop();
+        auto it = m_queued.find(top.ip);
+        if (it == m_queued.end() || it->second.rank != top.rank)
+            continue;
+        ip = top.ip;
+        timeline = {};
+        timeline.seen = it->second.seenNs;
+        timeline.enqueued = it->second.enqueuedNs;
+        m_queued.erase(it);
+        break;
+    }
+    timeline.dequeued = Clock::monotonicNs();
+    return DequeueResult::IP;
+}
+
+size_t IpQueue::size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queued.size();
+}
+
+std::vector<uint32_t> IpQueue::pending() {
+    std::vector<rankedIp> queued;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        queued.reserve(m_queued.size());
+        for (const auto& [ip, entry] : m_queued)
+            queued.push_back({entry.rank, entry.seq, ip});
+    }
+    // rankedIp orders the heap, so the first to be taken sorts last
+    std::sort(queued.rbegin(), queued.rend());
+    std::vector<uint32_t> ips;
+    ips.reserve(queued.size());
+    for (const rankedIp& entry : queued)
+        ips.push_back(entry.ip);
+    return ips;
+}
+
+void IpQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+    m_cond.notify_all();
+}
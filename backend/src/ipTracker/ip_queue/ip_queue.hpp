@@ -0,0 +1,72 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// outcome of IpQueue::pop()
+enum class DequeueResult { IP, TIMEOUT, STOPPED };
+
+// Destinations waiting for a lookup thread, each queued at most once. They
+// are taken by rank, see rankFor(), in arrival order among equals. Safe to
+// use from any number of threads
+class IpQueue {
+    public:
+        // seenNs is the Clock::monotonicNs() reading of the destination's
+        // first packet, 0 if it was not captured by this run. priority is
+        // the destination's recent traffic in bytes. An ip already queued
+        // only has its priority raised
+        void push(uint32_t ip, int64_t seenNs, uint64_t priority);
+        // raises the priority of ip if it is still queued, counting from
+        // when it was first queued. Returns whether its rank went up
+        bool promote(uint32_t ip, uint64_t priority);
+        // waits up to timeout for a destination, filling in the queue stages
+        // of timeline along with it
+        DequeueResult pop(uint32_t& ip, pipelineTimeline& timeline,
+                          std::chrono::milliseconds timeout);
+        size_t size();
+        // queued destinations in the order they would be taken
+        std::vector<uint32_t> pending();
+        // wakes every waiting pop(), which returns STOPPED from then on
+        void stop();
+
+    private:
+        // waiting this much longer ranks a destination like one with twice
+        // the traffic, so light destinations are not starved by heavy ones
+        // arriving after them
+        static constexpr int64_t AGE_STEP_NS = 10'000'000'000;
+        // the rank of a destination is the number of bits of its traffic
+        // plus one per AGE_STEP_NS waited. Only the time it was queued
+        // varies with the clock, and equally for every entry, so the order
+        // holds without re-ranking the heap as entries age
+        static int64_t rankFor(uint64_t priority, int64_t enqueuedNs);
+        struct queuedIp {
+                int64_t seenNs;
+                int64_t enqueuedNs;
+                int64_t rank;
+                uint64_t seq;  // arrival order
+        };
+        // heap entry, stale once its destination was promoted or dequeued
+        struct rankedIp {
+                int64_t rank;
+                uint64_t seq;
+                uint32_t ip;
+                bool operator<(const rankedIp& other) const {
+                    if (rank != other.rank)
+                        return rank < other.rank;
+                    return seq > other.seq;
+                }
+        };
+        // promotions push a new entry instead of re-sorting the heap, the
+        // map holds the live one for each destination
+        std::priority_queue<rankedIp> m_heap;
+        std::unordered_map<uint32_t, queuedIp> m_queued;
+        uint64_t m_nextSeq = 0;
+        bool m_stopped = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
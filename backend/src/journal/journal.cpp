@@ -0,0 +1,477 @@
+#include "journal.hpp"
+#include "utils/logger/logger.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// size every segment file is preallocated to
+constexpr size_t SEGMENT_SIZE = 16 << 20;
+// the writer waits this long for more records before committing a batch,
+// unless COMMIT_BYTES are already pending
+constexpr std::chrono::milliseconds COMMIT_INTERVAL{20};
+constexpr size_t COMMIT_BYTES = 256 << 10;
+// encoded bytes held in memory while the disk falls behind, records beyond
+// this are dropped
+constexpr size_t MAX_PENDING = 8 << 20;
+
+// Segment layout, in host byte order: the magic "HVJL", uint32 format
+// version, then records. Segments in any other format are neither read nor
+// appended to
+constexpr char SEGMENT_MAGIC[4] = {'H', 'V', 'J', 'L'};
+constexpr uint32_t FORMAT_VERSION = 2;
+constexpr size_t SEGMENT_HEADER_SIZE = sizeof(SEGMENT_MAGIC) + sizeof(uint32_t);
+// segmentVersion() of a segment without the magic
+constexpr uint32_t UNKNOWN_VERSION = UINT32_MAX;
+
+// Record layout, in host byte order:
+//   uint32 payload length, uint32 FNV-1a checksum of the payload
+//   payload: int64 timestamp (epoch ns), uint32 ip, uint32 asn,
+//            double latitude, double longitude, 7 strings (uint16 length +
+//            bytes: country, region, isp, org, as, asname, time_zone),
+//            uint8 hop count, hops (uint32 ip, float latency)
+// A zero length marks the unused, zero-filled tail of a segment
+constexpr size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+// Format version of the segment starting with head, 0 for one that nothing
+// was written to yet
+static uint32_t segmentVersion(const char* head, size_t size) {
+    static const char blank[SEGMENT_HEADER_SIZE] = {};
+    if (size < SEGMENT_HEADER_SIZE ||
+        std::memcmp(head, blank, SEGMENT_HEADER_SIZE) == 0)
+        return 0;
+    if (std::memcmp(head, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0)
+        return UNKNOWN_VERSION;
+    uint32_t version;
+    std::memcpy(&version, head + sizeof(SEGMENT_MAGIC), sizeof(version));
+    return version;
+}
+
+static uint32_t segmentVersion(const std::string& path) {
+    char head[SEGMENT_HEADER_SIZE] = {};
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    const ssize_t n = pread(fd, head, sizeof(head), 0);
+    ::close(fd);
+    return n < 0 ? 0 : segmentVersion(head, static_cast<size_t>(n));
+}
+
+static uint32_t checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+static void put(std::vector<char>& out, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void putString(std::vector<char>& out, stringId id) {
+    std::string_view str = StringPool::getInstance().view(id);
+    uint16_t len = static_cast<uint16_t>(std::min<size_t>(str.size(), 65535));
+    put(out, len);
+    out.insert(out.end(), str.data(), str.data() + len);
+}
+
+// bounds checked reader over one record payload
+struct recordReader {
+        const char* pos;
+        const char* end;
+
+        template <typename T>
+        bool get(T& value) {
+            if (static_cast<size_t>(end - pos) < sizeof(T))
+                return false;
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        bool getString(stringId& id) {
+            uint16_t len;
+            if (!get(len) || static_cast<size_t>(end - pos) < len)
+                return false;
+            id = StringPool::getInstance().intern(std::string_view(pos, len));
+            pos += len;
+            return true;
+        }
+};
+
+static bool decodeRecord(const char* data, size_t len, traceResult& result) {
+    recordReader in{data, data + len};
+    destInfo& d = result.dest_info;
+    uint8_t hopCount;
+    if (!in.get(result.timestamp_ns) || !in.get(d.ip) || !in.get(d.asn) ||
+        !in.get(d.latitude) || !in.get(d.longitude) ||
+        !in.getString(d.country) || !in.getString(d.region) ||
+        !in.getString(d.isp) || !in.getString(d.org) || !in.getString(d.as) ||
+        !in.getString(d.asname) || !in.getString(d.time_zone) ||
+        !in.get(hopCount))
+        return false;
+
+    for (uint8_t i = 0; i < hopCount; ++i) {
+        hopInfo hop;
+        if (!in.get(hop.hopIP) || !in.get(hop.latency))
+            return false;
+        result.hops.push_back(hop);
+    }
+    return in.pos == in.end;
+}
+
+// Maps a segment and calls fn (if set) for every intact record in its first
+// limit bytes. Returns the offset just past the last intact record, 0 for a
+// segment holding no records or written in another format
+static size_t walkSegment(const std::string& path, size_t limit,
+                          const std::function<void(traceResult&&)>* fn) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return 0;
+    }
+    const size_t size = std::min(static_cast<size_t>(st.st_size), limit);
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                     MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+    madvise(map, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    const char* base = static_cast<const char*>(map);
+    if (segmentVersion(base, size) != FORMAT_VERSION) {
+        munmap(map, static_cast<size_t>(st.st_size));
+        return 0;
+    }
+    size_t offset = SEGMENT_HEADER_SIZE;
+    while (offset + HEADER_SIZE <= size) {
+        uint32_t len, sum;
+        std::memcpy(&len, base + offset, sizeof(len));
+        std::memcpy(&sum, base + offset + sizeof(len), sizeof(sum));
+        const char* payload = base + offset + HEADER_SIZE;
+        if (len == 0 || len > size - offset - HEADER_SIZE ||
+            checksum(payload, len) != sum)
+            break;
+        if (fn) {
+            traceResult result;
+            if (!decodeRecord(payload, len, result))
+                break;
+            (*fn)(std::move(result));
+        }
+        offset += HEADER_SIZE + len;
+    }
+    munmap(map, static_cast<size_t>(st.st_size));
+    return offset;
+}
+
+TraceJournal::~TraceJournal() { stop(); }
+
+std::string TraceJournal::segmentPath(uint64_t index) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%012llu.seg",
+                  static_cast<unsigned long long>(index));
+    return (std::filesystem::path(m_dir) / name).string();
+}
+
+// indexes of the segment files in the journal directory, ascending
+std::vector<uint64_t> TraceJournal::listSegments() const {
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_dir, ec)) {
+        const std::filesystem::path& path = entry.path();
+        if (path.extension() != ".seg")
+            continue;
+        try {
+            segments.push_back(std::stoull(path.stem().string()));
+        } catch (const std::exception&) {
+            // not one of ours
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool TraceJournal::open(const std::string& dir, size_t maxSegments) {
+    m_dir = dir;
+    m_maxSegments = std::max<size_t>(1, maxSegments);
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+    if (ec) {
+        Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                  "Cannot create journal directory '" + m_dir +
+                                      "': " + ec.message());
+        return false;
+    }
+
+    std::vector<uint64_t> segments = listSegments();
+    uint32_t lastVersion = 0;
+    for (uint64_t index : segments) {
+        lastVersion = segmentVersion(segmentPath(index));
+        if (lastVersion != 0 && lastVersion != FORMAT_VERSION)
+            Logger::getInstance().log(
+                LogLevel::WARNING, __func__,
+                "Skipping journal segment '" + segmentPath(index) +
+                    "', it is not in format version " +
+                    std::to_string(FORMAT_VERSION));
+    }
+
+    // continue after the last intact record of the newest segment, anything
+    // behind it is a record torn by a crash. A segment in another format is
+    // left as it is and the journal moves on to a new one
+    uint64_t last = segments.empty() ? 1 : segments.back();
+    size_t offset = 0;
+    if (lastVersion == FORMAT_VERSION)
+        offset = walkSegment(segmentPath(last), SEGMENT_SIZE, nullptr);
+    else if (lastVersion != 0)
+        ++last;
+    if (!openSegment(last))
+        return false;
+    m_offset = std::max(offset, SEGMENT_HEADER_SIZE);
+    // zero out whatever followed the recovered position
+    if (ftruncate(m_fd, static_cast<off_t>(m_offset)) != 0 ||
+        ftruncate(m_fd, static_cast<off_t>(SEGMENT_SIZE)) != 0) {
+        closeSegment();
+        return false;
+    }
+    m_committedSegment.store(m_segment);
+    m_committedOffset.store(m_offset);
+    pruneSegments();
+    m_opened = true;
+    return true;
+}
+
+// writes all of data at offset, retrying short writes
+static bool writeAll(int fd, const char* data, size_t len, size_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool TraceJournal::openSegment(uint64_t index) {
+    const std::string path = segmentPath(index);
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                  "Cannot open journal segment '" + path +
+                                      "': " + std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) < SEGMENT_SIZE &&
+        ftruncate(m_fd, static_cast<off_t>(SEGMENT_SIZE)) != 0) {
+        closeSegment();
+        return false;
+    }
+    // only ever opened empty or in the current format, so the header is
+    // either missing or already the same
+    char header[SEGMENT_HEADER_SIZE];
+    std::memcpy(header, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    std::memcpy(header + sizeof(SEGMENT_MAGIC), &FORMAT_VERSION,
+                sizeof(FORMAT_VERSION));
+    if (!writeAll(m_fd, header, sizeof(header), 0)) {
+        Logger::getInstance().log(LogLevel::ERROR, __func__,
+                                  "Cannot write journal segment '" + path +
+                                      "': " + std::strerror(errno));
+        closeSegment();
+        return false;
+    }
+    m_segment = index;
+    m_offset = SEGMENT_HEADER_SIZE;
+    return true;
+}
+
+void TraceJournal::closeSegment() {
+    if (m_fd < 0)
+        return;
+    fdatasync(m_fd);
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+// deletes the oldest segments past the configured count
+void TraceJournal::pruneSegments() {
+    std::vector<uint64_t> segments = listSegments();
+    if (segments.size() <= m_maxSegments)
+        return;
+    for (size_t i = 0; i < segments.size() - m_maxSegments; ++i) {
+        std::error_code ec;
+        std::filesystem::remove(segmentPath(segments[i]), ec);
+    }
+}
+
+void TraceJournal::start() {
+    if (!m_opened || m_writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_stopping = false;
+    }
+    m_writer = std::thread(&TraceJournal::writerLoop, this);
+}
+
+void TraceJournal::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_stopping = true;
+    }
+    m_pendingCond.notify_one();
+    if (m_writer.joinable())
+        m_writer.join();
+    closeSegment();
+}
+
+void TraceJournal::append(const traceResult& result) {
+    if (!m_opened)
+        return;
+
+    // encode outside the lock, lookup threads only contend for the copy
+    thread_local std::vector<char> record;
+    record.clear();
+    record.resize(HEADER_SIZE);
+    const destInfo& d = result.dest_info;
+    put(record, result.timestamp_ns);
+    put(record, d.ip);
+    put(record, d.asn);
+    put(record, d.latitude);
+    put(record, d.longitude);
+    for (stringId id :
+         {d.country, d.region, d.isp, d.org, d.as, d.asname, d.time_zone})
+        putString(record, id);
+    put(record, result.hops.count);
+    for (const hopInfo& hop : result.hops) {
+        put(record, hop.hopIP);
+        put(record, hop.latency);
+    }
+    const uint32_t len = static_cast<uint32_t>(record.size() - HEADER_SIZE);
+    const uint32_t sum = checksum(record.data() + HEADER_SIZE, len);
+    std::memcpy(record.data(), &len, sizeof(len));
+    std::memcpy(record.data() + sizeof(len), &sum, sizeof(sum));
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        if (m_pending.size() + record.size() > MAX_PENDING) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // the writer waits for the first record of a batch, and again for
+        // the batch to fill up
+        const size_t before = m_pending.size();
+        m_pending.insert(m_pending.end(), record.begin(), record.end());
+        wake = before == 0 ||
+               (before < COMMIT_BYTES && m_pending.size() >= COMMIT_BYTES);
+    }
+    if (wake)
+        m_pendingCond.notify_one();
+}
+
+void TraceJournal::writerLoop() {
+    std::vector<char> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_pendingMutex);
+            m_pendingCond.wait(
+                lock, [this] { return m_stopping || !m_pending.empty(); });
+            // group commit: let more records join the batch so that one
+            // fdatasync covers all of them
+            if (!m_stopping && m_pending.size() < COMMIT_BYTES)
+                m_pendingCond.wait_for(lock, COMMIT_INTERVAL, [this] {
+                    return m_stopping || m_pending.size() >= COMMIT_BYTES;
+                });
+            if (m_pending.empty() && m_stopping)
+                break;
+            batch.swap(m_pending);
+        }
+        writeBatch(batch);
+        batch.clear();
+    }
+}
+
+// Appends a batch of whole records, rolling over to a new segment whenever
+// the next record does not fit. Contiguous records go out in a single write
+void TraceJournal::writeBatch(const std::vector<char>& batch) {
+    size_t runStart = 0, pos = 0;
+    auto flushRun = [&]() {
+        if (pos == runStart)
+            return true;
+        if (m_fd < 0 ||
+            !writeAll(m_fd, batch.data() + runStart, pos - runStart,
+                      m_offset)) {
+            Logger::getInstance().log(LogLevel::ERROR, "writeBatch",
+                                      "Journal write failed: " +
+                                          std::string(std::strerror(errno)));
+            return false;
+        }
+        m_offset += pos - runStart;
+        runStart = pos;
+        return true;
+    };
+
+    while (pos < batch.size()) {
+        uint32_t len;
+        std::memcpy(&len, batch.data() + pos, sizeof(len));
+        const size_t recordSize = HEADER_SIZE + len;
+        if (m_offset + (pos - runStart) + recordSize > SEGMENT_SIZE) {
+            if (!flushRun())
+                return;
+            closeSegment();
+            if (!openSegment(m_segment + 1))
+                return;
+            pruneSegments();
+            m_committedSegment.store(m_segment);
+            m_committedOffset.store(m_offset);
+        }
+        pos += recordSize;
+    }
+    if (!flushRun())
+        return;
+    fdatasync(m_fd);
+    m_committedOffset.store(m_offset);
+}
+
+size_t TraceJournal::replay(
+    const std::function<void(traceResult&&)>& fn) const {
+    if (!m_opened)
+        return 0;
+
+    size_t count = 0;
+    std::function<void(traceResult&&)> counted = [&](traceResult&& result) {
+        ++count;
+        fn(std::move(result));
+    };
+    const uint64_t current = m_committedSegment.load();
+    for (uint64_t index : listSegments()) {
+        if (index > current)
+            break;
+        // the segment being written is only read up to its last commit
+        size_t limit =
+            (index == current) ? m_committedOffset.load() : SEGMENT_SIZE;
+        walkSegment(segmentPath(index), limit, &counted);
+    }
+    return count;
+}
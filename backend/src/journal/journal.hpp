@@ -0,0 +1,72 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Append-only on-disk log of finished results, kept so that the history
+// survives a restart.
+//
+// Results are stored as length-prefixed, checksummed binary records in a
+// directory of fixed-size segment files, each headed by its format version.
+// Strings are written inline rather than as StringPool ids, since ids only
+// hold for the process that made them.
+// Lookup threads only encode into an in-memory buffer, a dedicated writer
+// thread moves that buffer to disk in batches with a single fdatasync per
+// batch (group commit). Segments are read back through mmap.
+class TraceJournal {
+    public:
+        ~TraceJournal();
+
+        // Opens or creates the journal in dir, keeping at most maxSegments
+        // segment files. Recovers the write position after the last intact
+        // record. Returns false if the directory cannot be used
+        bool open(const std::string& dir, size_t maxSegments);
+        void start();
+        // stops the writer after flushing everything appended so far
+        void stop();
+
+        // Queues a result to be written, never blocks on disk. Results are
+        // dropped if the writer falls too far behind
+        void append(const traceResult& result);
+
+        // Calls fn for every committed record, oldest first. Returns the
+        // number of records read
+        size_t replay(const std::function<void(traceResult&&)>& fn) const;
+
+        uint64_t droppedCount() const { return m_dropped.load(); }
+
+    private:
+        void writerLoop();
+        void writeBatch(const std::vector<char>& batch);
+        bool openSegment(uint64_t index);
+        void closeSegment();
+        void pruneSegments();
+        std::string segmentPath(uint64_t index) const;
+        std::vector<uint64_t> listSegments() const;
+
+        std::string m_dir;
+        size_t m_maxSegments = 0;
+        bool m_opened = false;
+
+        // segment currently written to, only touched by the writer thread
+        // once it has started
+        int m_fd = -1;
+        uint64_t m_segment = 0;
+        size_t m_offset = 0;
+        // committed size of the current segment, what replay() may read
+        std::atomic<uint64_t> m_committedSegment{0};
+        std::atomic<size_t> m_committedOffset{0};
+
+        std::mutex m_pendingMutex;
+        std::condition_variable m_pendingCond;
+        std::vector<char> m_pending;
+        bool m_stopping = false;
+        std::thread m_writer;
+        std::atomic<uint64_t> m_dropped{0};
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <cstdint>
+#include <string>
+
+// Replaceable halves of a lookup. Lookup uses traceroute() and the ip-api.com
+// request unless backends are installed with Lookup::setBackends(), e.g. the
+// simulator's for testing without raw sockets or network access. Both are
+// called concurrently by every lookup thread
+
+class TraceBackend {
+    public:
+        virtual ~TraceBackend() = default;
+        // same contract as traceroute()
+        virtual hopList trace(const std::string& ip, int maxHops,
+                              uint32_t timeoutMs) = 0;
+};
+
+class GeoBackend {
+    public:
+        virtual ~GeoBackend() = default;
+        // a zeroed destInfo (ip 0) reports a failed lookup
+        virtual destInfo lookup(const std::string& ip) = 0;
+};
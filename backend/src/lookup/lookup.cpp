@@ -1,7 +1,13 @@
 #include "lookup.hpp"
 #include "ipTracker/ipTracker.hpp"
 #include "platform_dependent/traceroute/traceroute.hpp"
+#include "utils/clock/clock.hpp"
 #include "utils/logger/logger.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 // #include <filesystem>
 #include <thread>
@@ -9,7 +15,43 @@
 #include <nlohmann/json.hpp>
 
 Lookup::Lookup(IpTracker* ipTracker)
-    : m_running(false), m_ipTracker(ipTracker) {}
+    : m_running(false),
+      m_ipTracker(ipTracker),
+      m_workerCount(0),
+      m_retire(0),
+      m_idleWaits(0),
+      m_avgProcessNs(0),
+      m_idleIntervals(0),
+      m_tracerouteTime(Metrics::getInstance().histogram(
+          "hovia_traceroute_duration_seconds",
+          "Time taken to traceroute a destination")),
+      m_lookupTime(Metrics::getInstance().histogram(
+          "hovia_lookup_duration_seconds",
+          "Time taken by the geolocation lookup of a destination")),
+      m_lookupErrors(Metrics::getInstance().counter(
+          "hovia_lookup_errors_total",
+          "Geolocation lookups that failed or returned no data")),
+      m_traced(Metrics::getInstance().counter(
+          "hovia_traced_destinations_total",
+          "Destinations traced and looked up")) {
+    Metrics& metrics = Metrics::getInstance();
+    metrics.gauge("hovia_lookup_workers", "Running lookup threads",
+                  [this] { return static_cast<double>(m_workerCount.load()); });
+    metrics.gauge("hovia_lookup_average_seconds",
+                  "Moving average of the time taken to process a destination",
+                  [this] { return m_avgProcessNs.load() / 1e9; });
+}
+
+// how often the scaler reconsiders the size of the pool
+constexpr auto SCALE_INTERVAL = std::chrono::seconds(1);
+// the pool grows until the queued destinations are expected to be processed
+// within this many seconds
+constexpr double TARGET_DRAIN_SECONDS = 5.0;
+// intervals in a row in which some worker waited IDLE_WAIT without getting
+// an IP before a worker is retired
+constexpr unsigned IDLE_INTERVALS_BEFORE_SHRINK = 10;
+// how long an idle worker waits for an IP before checking if it was retired
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(500);
 
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
     auto* response = static_cast<std::string*>(userp);
@@ -17,6 +59,26 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
     return size * nmemb;
 }
 
+// interns the string stored under key, missing or non-string fields map to the
+// empty string id
+static stringId internField(const nlohmann::json& json, const char* key) {
+    auto it = json.find(key);
+    if (it == json.end() || !it->is_string())
+        return 0;
+    return StringPool::getInstance().intern(
+        it->get_ref<const std::string&>());
+}
+
+// extracts the AS number from ip-api's "AS15169 Google LLC" form
+static uint32_t parseAsn(std::string_view as) {
+    if (as.size() < 3 || as[0] != 'A' || as[1] != 'S')
+        return 0;
+    uint32_t asn = 0;
+    for (size_t i = 2; i < as.size() && as[i] >= '0' && as[i] <= '9'; ++i)
+        asn = asn * 10 + static_cast<uint32_t>(as[i] - '0');
+    return asn;
+}
+
 destInfo Lookup::lookupAPI(const std::string& ip) {
     destInfo info{};
     std::string url =
@@ -46,106 +108,222 @@ destInfo Lookup::lookupAPI(const std::string& ip) {
     if (!json.is_object() || json["status"] != "success")
         return info;
 
-    strncpy(info.ip, ip.c_str(), sizeof(info.ip));
-    info.ip[sizeof(info.ip) - 1] = '\0';
-    info.country = json["country"];
-    info.region = json["regionName"];
-    info.isp = json["isp"];
-    info.org = json["org"];
-    info.as = json["as"];
-    info.asname = json["asname"];
-    info.latitude = json["lat"];
-    info.longitude = json["lon"];
-    info.time_zone = json["timezone"];
-
-    return info;
-}
-
-// Converts a uint32_t IP (in host byte order) to dotted-decimal string
-std::string ipToStr(uint32_t ip) {
     in_addr addr{};
-    addr.s_addr = htonl(ip);  // Convert to network byte order
-    char ipStr[INET_ADDRSTRLEN] = {};
+    if (inet_pton(AF_INET, ip.c_str(), &addr) == 1)
+        info.ip = ntohl(addr.s_addr);
+    info.country = internField(json, "country");
+    info.region = internField(json, "regionName");
+    info.isp = internField(json, "isp");
+    info.org = internField(json, "org");
+    info.as = internField(json, "as");
+    info.asn = parseAsn(StringPool::getInstance().view(info.as));
+    info.asname = internField(json, "asname");
+    info.latitude = json.value("lat", 0.0);
+    info.longitude = json.value("lon", 0.0);
+    info.time_zone = internField(json, "timezone");
 
-    // Convert IPv4 address to string
-    const char* res = inet_ntop(AF_INET, &addr, ipStr, sizeof(ipStr));
-    if (res == nullptr) {
-        return "";
-    }
-
-    return std::string(ipStr);
+    return info;
 }
 
-traceResult Lookup::processIp(const uint32_t& ip) {
+traceResult Lookup::processIp(const uint32_t& ip, pipelineTimeline& t) {
     traceResult result;
     std::string ipStr = ipToStr(ip);
-    result.timestamp = Logger::getInstance().getCurrentTimestamp();
-    result.hops = traceroute(ipStr, m_ipTracker->pSettings->getMaxHops(),
-                             m_ipTracker->pSettings->getTimeout());
-
-    if (m_ipTracker->pSettings->getLookupMode() == LookupMode::API) {
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Calling lookupAPI()");
-        result.dest_info = lookupAPI(ipStr);
+    result.timestamp_ns = Clock::nowNs();
+    t.traceStart = Clock::monotonicNs();
+    const int maxHops = m_ipTracker->pSettings->getMaxHops();
+    const uint32_t timeout = m_ipTracker->pSettings->getTimeout();
+    result.hops = m_traceBackend
+                      ? m_traceBackend->trace(ipStr, maxHops, timeout)
+                      : traceroute(ipStr, maxHops, timeout);
+    t.traceEnd = Clock::monotonicNs();
+    m_tracerouteTime.observe(std::chrono::nanoseconds(t.traceEnd -
+                                                      t.traceStart));
+
+    // an installed backend replaces the configured lookup mode
+    if (m_geoBackend ||
+        m_ipTracker->pSettings->getLookupMode() == LookupMode::API) {
+        LOG_DEBUG("Calling lookupAPI()");
+        t.lookupStart = Clock::monotonicNs();
+        result.dest_info =
+            m_geoBackend ? m_geoBackend->lookup(ipStr) : lookupAPI(ipStr);
+        t.lookupEnd = Clock::monotonicNs();
+        m_lookupTime.observe(std::chrono::nanoseconds(t.lookupEnd -
+                                                      t.lookupStart));
+        if (result.dest_info.ip == 0)
+            m_lookupErrors.inc();
     } else {
         if (!std::filesystem::exists("db.db")) {
             Logger::getInstance().log(LogLevel::ERROR, __func__,
                                       "Db was not found, process exited.");
             return {};
         }
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Calling lookupDB()");
+        LOG_DEBUG("Calling lookupDB()");
         // result.dest_info = lookupDB(ipStr);
     }
 
+    m_traced.inc();
     return result;
 }
 
-void Lookup::lookupLoop() {
+void Lookup::setBackends(std::unique_ptr<TraceBackend> traceBackend,
+                         std::unique_ptr<GeoBackend> geoBackend) {
+    m_traceBackend = std::move(traceBackend);
+    m_geoBackend = std::move(geoBackend);
+}
+
+void Lookup::recordLatency(int64_t ns) {
+    // exponential moving average weighting the latest sample by 1/8, a lost
+    // update from a concurrent worker only skips one sample
+    const int64_t avg = m_avgProcessNs.load(std::memory_order_relaxed);
+    m_avgProcessNs.store(avg == 0 ? ns : avg + (ns - avg) / 8,
+                         std::memory_order_relaxed);
+}
+
+bool Lookup::shouldRetire() {
+    int pending = m_retire.load();
+    while (pending > 0) {
+        if (m_retire.compare_exchange_weak(pending, pending - 1))
+            return true;
+    }
+    return false;
+}
+
+void Lookup::lookupLoop(std::shared_ptr<std::atomic<bool>> finished) {
     uint32_t ip;
+    pipelineTimeline timeline;
     traceResult newResult;
-    while (m_running.load()) {
-        if (!m_ipTracker->dequeueIp(ip))
+    while (m_running.load() && !shouldRetire()) {
+        DequeueResult got = m_ipTracker->dequeueIp(ip, timeline, IDLE_WAIT);
+        if (got == DequeueResult::STOPPED)
             break;
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Dequeued '" + ipToStr(ip) +
-                                          "' IP from the IP Queue");
-
-        newResult = processIp(ip);
-        m_ipTracker->enqueueResult(newResult);
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Pushed results of '" + ipToStr(ip) +
-                                          "' IP from the Results Queue");
+        if (got == DequeueResult::TIMEOUT) {
+            m_idleWaits.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        LOG_DEBUG("Dequeued '{}' IP from the IP Queue", ipToStr(ip));
+
+        const int64_t start = Clock::monotonicNs();
+        newResult = processIp(ip, timeline);
+        recordLatency(Clock::monotonicNs() - start);
+        m_ipTracker->enqueueResult(std::move(newResult), timeline);
+        LOG_DEBUG("Pushed results of '{}' IP to the Results Queue",
+                  ipToStr(ip));
+    }
+    m_workerCount.fetch_sub(1);
+    finished->store(true);
+}
+
+void Lookup::startWorker() {
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    m_workerCount.fetch_add(1);
+    m_workers.push_back(
+        {std::thread(&Lookup::lookupLoop, this, finished), finished});
+}
+
+void Lookup::resize() {
+    m_workers.erase(std::remove_if(m_workers.begin(), m_workers.end(),
+                                   [](worker& w) {
+                                       if (!w.finished->load())
+                                           return false;
+                                       w.thread.join();
+                                       return true;
+                                   }),
+                    m_workers.end());
+
+    const auto& settings = m_ipTracker->pSettings;
+    const size_t minWorkers =
+        std::max<size_t>(1, settings->getLookupThreadsMin());
+    const size_t maxWorkers =
+        std::max<size_t>(minWorkers, settings->getLookupThreadsMax());
+    const size_t depth = m_ipTracker->ipQueueDepth();
+    const double avgSeconds = m_avgProcessNs.load() / 1e9;
+
+    // workers that will keep running once pending retirements are claimed
+    const size_t running = m_workerCount.load();
+    const size_t retiring = static_cast<size_t>(std::max(0, m_retire.load()));
+    const size_t current = running > retiring ? running - retiring : 0;
+
+    // an empty queue alone does not make the pool idle, every worker may be
+    // busy with a trace. Only a worker that timed out waiting for an IP had
+    // nothing to do
+    const bool idle = m_idleWaits.exchange(0) > 0;
+    size_t target = current;
+    if (depth > 0) {
+        m_idleIntervals = 0;
+        // before the first destination is processed there is nothing to
+        // estimate from, so grow one worker at a time
+        const size_t needed =
+            avgSeconds > 0
+                ? static_cast<size_t>(
+                      std::ceil(depth * avgSeconds / TARGET_DRAIN_SECONDS))
+                : current + 1;
+        target = std::max(current, needed);
+    } else if (!idle) {
+        m_idleIntervals = 0;
+    } else if (++m_idleIntervals >= IDLE_INTERVALS_BEFORE_SHRINK) {
+        m_idleIntervals = 0;
+        if (current > 0)
+            target = current - 1;
+    }
+    target = std::clamp(target, minWorkers, maxWorkers);
+
+    if (target > current) {
+        // withdraw the retirements no worker has claimed yet before starting
+        // new threads
+        const size_t withdrawn =
+            static_cast<size_t>(std::max(0, m_retire.exchange(0)));
+        const size_t start = target - current > withdrawn
+                                 ? target - current - withdrawn
+                                 : 0;
+        for (size_t i = 0; i < start; ++i)
+            startWorker();
+        LOG_INFO("Growing the lookup pool from {} to {} threads, {} IPs "
+                 "queued",
+                 current, target, depth);
+    } else if (target < current) {
+        m_retire.fetch_add(static_cast<int>(current - target));
+        LOG_INFO("Shrinking the lookup pool from {} to {} threads", current,
+                 target);
     }
 }
 
-void Lookup::startLookup(size_t numThreads) {
+void Lookup::scaleLoop() {
+    std::unique_lock<std::mutex> lock(m_scaleMutex);
+    while (!m_scaleCond.wait_for(lock, SCALE_INTERVAL,
+                                 [this] { return !m_running.load(); }))
+        resize();
+}
+
+void Lookup::startLookup() {
     if (m_running.exchange(true))
         return;
-    m_lookupThreads.clear();
-    // generate numThreads threads that run lookupLoop
-    for (size_t i = 0; i < numThreads; ++i) {
-        if (m_ipTracker->pSettings->hasVerbose())
-            Logger::getInstance().log(LogLevel::INFO, __func__,
-                                      "Initialized lookup thread no. #" +
-                                          std::to_string(i));
-        m_lookupThreads.emplace_back(&Lookup::lookupLoop, this);
+    m_workers.clear();
+    m_retire.store(0);
+    m_idleWaits.store(0);
+    m_idleIntervals = 0;
+    const size_t initial =
+        std::max<size_t>(1, m_ipTracker->pSettings->getLookupThreadsMin());
+    for (size_t i = 0; i < initial; ++i) {
+        LOG_DEBUG("Initialized lookup thread no. #{}", i);
+        startWorker();
     }
+    m_scaler = std::thread(&Lookup::scaleLoop, this);
 }
 
 void Lookup::stopLookup() {
-    m_running.store(false);
-    if (m_ipTracker->pSettings->hasVerbose())
-        Logger::getInstance().log(LogLevel::INFO, __func__,
-                                  "Attempting to join all lookup threads");
-    for (auto& t : m_lookupThreads) {
-        // try and join each of the threads in m_lookupThreads
-        if (t.joinable())
-            t.join();
+    {
+        std::lock_guard<std::mutex> lock(m_scaleMutex);
+        m_running.store(false);
+    }
+    m_scaleCond.notify_all();
+    if (m_scaler.joinable())
+        m_scaler.join();
+
+    LOG_DEBUG("Attempting to join all lookup threads");
+    for (auto& w : m_workers) {
+        // try and join each of the remaining workers
+        if (w.thread.joinable())
+            w.thread.join();
     }
-    m_lookupThreads.clear();
+    m_workers.clear();
 }
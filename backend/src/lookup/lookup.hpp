@@ -1,6 +1,12 @@
 #pragma once
+#include "lookup/backend.hpp"
+#include "metrics/metrics.hpp"
 #include "utils/common_structs.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
 #include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <pcap.h>
 #include <vector>
@@ -12,13 +18,53 @@ class Lookup {
     public:
         Lookup(IpTracker* ipTracker);
         destInfo lookupAPI(const std::string& ip);
-        traceResult processIp(const uint32_t& ip);
-        void lookupLoop();
-        void startLookup(size_t numThreads = 2);
+        // traces and looks up ip, timeline holds the stages it went through
+        // before and is completed with the trace and lookup times
+        traceResult processIp(const uint32_t& ip, pipelineTimeline& timeline);
+        // runs until the tracker stops or the worker is retired, then raises
+        // finished so the scaler can join it
+        void lookupLoop(std::shared_ptr<std::atomic<bool>> finished);
+        // replaces traceroute() and the ip-api.com lookup, a null backend
+        // keeps the real one. Call before startLookup()
+        void setBackends(std::unique_ptr<TraceBackend> traceBackend,
+                         std::unique_ptr<GeoBackend> geoBackend);
+        // starts lookupThreadsMin workers and the thread growing the pool
+        // up to lookupThreadsMax while the IP queue backs up
+        void startLookup();
         void stopLookup();
 
     private:
+        struct worker {
+                std::thread thread;
+                std::shared_ptr<std::atomic<bool>> finished;
+        };
+
+        void startWorker();
+        // claims one pending retirement, if any
+        bool shouldRetire();
+        void scaleLoop();
+        // joins exited workers and moves the pool towards its target size
+        void resize();
+        void recordLatency(int64_t ns);
+
         std::atomic<bool> m_running;
         IpTracker* m_ipTracker;
-        std::vector<std::thread> m_lookupThreads;
+        // only touched by startLookup(), stopLookup() and the scaler
+        std::vector<worker> m_workers;
+        std::atomic<size_t> m_workerCount;  // workers still running
+        std::atomic<int> m_retire;          // workers asked to exit
+        // waits that ended without an IP since the scaler last looked
+        std::atomic<size_t> m_idleWaits;
+        // moving average of the time processIp() takes, 0 until the first
+        std::atomic<int64_t> m_avgProcessNs;
+        unsigned m_idleIntervals;
+        std::thread m_scaler;
+        std::mutex m_scaleMutex;
+        std::condition_variable m_scaleCond;
+        std::unique_ptr<TraceBackend> m_traceBackend;
+        std::unique_ptr<GeoBackend> m_geoBackend;
+        Histogram& m_tracerouteTime;
+        Histogram& m_lookupTime;
+        Counter& m_lookupErrors;
+        Counter& m_traced;
 };
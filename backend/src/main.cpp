@@ -1,7 +1,100 @@
 #include "ipTracker/ipTracker.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <curl/curl.h>
+#include <limits>
+
+static void printUsage(const char* name) {
+    std::cerr
+        << "Usage: " << name << " [options]\n"
+        << "Traffic source, the network interface by default:\n"
+        << "  --replay <file>       read packets from a pcap/pcapng file\n"
+        << "  --speed <x>           replay at x times the original timing, 0 "
+           "(the default) as fast as possible\n"
+        << "  --generate <pps>      generate packets at pps per second, 0 as "
+           "fast as possible, needs --simulate\n"
+        << "  --destinations <n>    destinations the generator picks from, "
+           "at most 16777216 (10000)\n"
+        << "Simulated network, instead of traceroute and ip-api.com:\n"
+        << "  --simulate            trace and look up against the simulator\n"
+        << "  --hop-latency <ms>    round trip added per hop (5)\n"
+        << "  --loss <percent>      chance a hop does not answer (2)\n"
+        << "  --icmp-rate <n>       replies per second before routers drop "
+           "probes, 0 unlimited (0)\n"
+        << "  --geo-latency <ms>    geolocation response time (30)\n"
+        << "  --geo-rate <n>        lookups per second before the service "
+           "refuses them, 0 unlimited (0)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string replayPath;
+    double replaySpeed = 0;
+    double generateRate = -1;  // < 0 when not generating
+    double destinations = 10000;
+    bool simulate = false;
+    simConfig sim;
+    double icmpRate = sim.icmpRate, geoRate = sim.geoRate;
+
+    // flags taking a finite, non-negative number up to max. Integer flags
+    // reject fractions, their values are converted to integer types
+    struct numericFlag {
+            const char* name;
+            double* value;
+            double max;
+            bool integer;
+    };
+    constexpr double ANY = std::numeric_limits<double>::max();
+    constexpr double UINT32 = std::numeric_limits<uint32_t>::max();
+    const numericFlag numeric[] = {
+        {"--speed", &replaySpeed, ANY, false},
+        {"--generate", &generateRate, ANY, false},
+        {"--destinations", &destinations, 1 << 24, true},
+        {"--hop-latency", &sim.hopLatencyMs, ANY, false},
+        {"--loss", &sim.lossPercent, 100, false},
+        {"--icmp-rate", &icmpRate, UINT32, true},
+        {"--geo-latency", &sim.geoLatencyMs, ANY, false},
+        {"--geo-rate", &geoRate, UINT32, true},
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const numericFlag* flag = nullptr;
+        for (const auto& candidate : numeric)
+            if (std::strcmp(argv[i], candidate.name) == 0)
+                flag = &candidate;
+
+        if (flag && i + 1 < argc) {
+            char* end;
+            double value = std::strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !std::isfinite(value) ||
+                value < 0 || value > flag->max ||
+                (flag->integer && std::floor(value) != value)) {
+                std::cerr << "Invalid value for " << flag->name << ": "
+                          << argv[i] << "\n";
+                printUsage(argv[0]);
+                return 1;
+            }
+            *flag->value = value;
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--simulate") == 0) {
+            simulate = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (destinations < 1 || (generateRate >= 0 && !replayPath.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    // generated destinations are random public addresses, tracing them for
+    // real would probe and geolocate thousands of strangers' hosts
+    if (generateRate >= 0 && !simulate) {
+        std::cerr << "--generate needs --simulate\n";
+        return 1;
+    }
 
-int main() {
     // initialize pSettings ptr with the settings found in SETTINGS_PATH
     std::shared_ptr<Settings> pSettings = Settings::loadFromFile();
     if (!pSettings) {
@@ -11,6 +104,16 @@ int main() {
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
     IpTracker appManager;
+    if (!replayPath.empty())
+        appManager.setReplay(replayPath, replaySpeed);
+    if (generateRate >= 0)
+        appManager.setSynthetic(generateRate,
+                                static_cast<size_t>(destinations));
+    if (simulate) {
+        sim.icmpRate = static_cast<uint32_t>(icmpRate);
+        sim.geoRate = static_cast<uint32_t>(geoRate);
+        appManager.setSimulation(sim);
+    }
     appManager.start();
 
     std::cout << "Press enter to stop capturing\n";
@@ -0,0 +1,165 @@
+#include "metrics.hpp"
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const shard& s : m_shards)
+        total += s.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+// threads are spread over the shards in the order they first count something
+size_t Counter::shardIndex() {
+    static std::atomic<size_t> next{0};
+    thread_local const size_t index =
+        next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+    return index;
+}
+
+// Buckets are found in units of 1us / SUB_BUCKETS. Octave k covers
+// (SUB_BUCKETS << k, SUB_BUCKETS << (k + 1)] of them in buckets 2^k units
+// wide
+void Histogram::observe(std::chrono::nanoseconds duration) {
+    const uint64_t ns =
+        duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+    size_t i = BUCKETS;
+    if (ns <= uint64_t{1000} << OCTAVES) {
+        const uint64_t units = (ns * SUB_BUCKETS + 999) / 1000;
+        if (units <= SUB_BUCKETS) {
+            i = 0;
+        } else {
+            // highest set bit of units - 1, SUB_BUCKET_BITS for octave 0
+            const size_t top =
+                63 - static_cast<size_t>(__builtin_clzll(units - 1));
+            const size_t k = top - SUB_BUCKET_BITS;
+            const size_t sub = ((units - 1) >> k) - SUB_BUCKETS;
+            i = 1 + k * SUB_BUCKETS + sub;
+        }
+    }
+    m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+}
+
+double Histogram::upperBound(size_t i) {
+    if (i == 0)
+        return 1e-6;
+    const size_t k = (i - 1) / SUB_BUCKETS;
+    const size_t sub = (i - 1) % SUB_BUCKETS;
+    const uint64_t units = (SUB_BUCKETS + sub + 1) << k;
+    return static_cast<double>(units) / SUB_BUCKETS / 1e6;
+}
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+static const char* const TYPE_NAMES[] = {"counter", "gauge", "histogram"};
+
+// a name registered again as another type would hand out a null metric,
+// which is a bug in the caller
+Metrics::metric* Metrics::find(const std::string& name, metricType type) {
+    for (metric& m : m_metrics) {
+        if (m.name != name)
+            continue;
+        if (m.type != type)
+            throw std::logic_error(
+                "Metric '" + name + "' is a " +
+                TYPE_NAMES[static_cast<int>(m.type)] + ", not a " +
+                TYPE_NAMES[static_cast<int>(type)]);
+        return &m;
+    }
+    return nullptr;
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (metric* existing = find(name, metricType::COUNTER))
+        return *existing->counter;
+    m_metrics.push_back({name, help, metricType::COUNTER,
+                         std::make_unique<Counter>(), nullptr, nullptr});
+    return *m_metrics.back().counter;
+}
+
+Histogram& Metrics::histogram(const std::string& name,
+                              const std::string& help) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (metric* existing = find(name, metricType::HISTOGRAM))
+        return *existing->histogram;
+    m_metrics.push_back({name, help, metricType::HISTOGRAM, nullptr,
+                         std::make_unique<Histogram>(), nullptr});
+    return *m_metrics.back().histogram;
+}
+
+// a gauge registered again takes the new callback
+void Metrics::gauge(const std::string& name, const std::string& help,
+                    std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (metric* existing = find(name, metricType::GAUGE)) {
+        existing->read = std::move(read);
+        return;
+    }
+    m_metrics.push_back(
+        {name, help, metricType::GAUGE, nullptr, nullptr, std::move(read)});
+}
+
+static void appendNumber(std::string& out, uint64_t value) {
+    char buf[24];
+    std::to_chars_result res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+static void appendNumber(std::string& out, double value) {
+    // %.9g keeps microsecond bucket bounds and ns sums exact
+    char buf[32];
+    int len = std::snprintf(buf, sizeof(buf), "%.9g", value);
+    out.append(buf, static_cast<size_t>(len));
+}
+
+std::string Metrics::render() const {
+    std::string out;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const metric& m : m_metrics) {
+        out += "# HELP " + m.name + " " + m.help + "\n";
+        out += "# TYPE " + m.name + " " +
+               TYPE_NAMES[static_cast<int>(m.type)] + "\n";
+
+        switch (m.type) {
+            case metricType::COUNTER:
+                out += m.name + " ";
+                appendNumber(out, m.counter->value());
+                out += "\n";
+                break;
+            case metricType::GAUGE:
+                out += m.name + " ";
+                appendNumber(out, m.read ? m.read() : 0.0);
+                out += "\n";
+                break;
+            case metricType::HISTOGRAM: {
+                // buckets are cumulative, bounds in seconds
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+                    cumulative += m.histogram->bucket(i);
+                    out += m.name + "_bucket{le=\"";
+                    appendNumber(out, Histogram::upperBound(i));
+                    out += "\"} ";
+                    appendNumber(out, cumulative);
+                    out += "\n";
+                }
+                cumulative += m.histogram->bucket(Histogram::BUCKETS);
+                out += m.name + "_bucket{le=\"+Inf\"} ";
+                appendNumber(out, cumulative);
+                out += "\n" + m.name + "_sum ";
+                appendNumber(out,
+                             static_cast<double>(m.histogram->sumNs()) / 1e9);
+                out += "\n" + m.name + "_count ";
+                appendNumber(out, cumulative);
+                out += "\n";
+                break;
+            }
+        }
+    }
+    return out;
+}
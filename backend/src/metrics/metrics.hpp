@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Monotonic counter split over cache-line sized shards. Each thread adds to
+// its own shard, so threads bumping the same counter on a hot path do not
+// contend on one cache line; reading sums the shards
+class Counter {
+    public:
+        void inc(uint64_t n = 1) {
+            m_shards[shardIndex()].value.fetch_add(n,
+                                                   std::memory_order_relaxed);
+        }
+        uint64_t value() const;
+
+    private:
+        static constexpr size_t SHARDS = 16;
+        struct alignas(64) shard {
+                std::atomic<uint64_t> value{0};
+        };
+        static size_t shardIndex();
+
+        std::array<shard, SHARDS> m_shards;
+};
+
+// Latency histogram laid out like an HDR histogram: one bucket up to 1us,
+// then every power of two up to about 2 minutes split into SUB_BUCKETS
+// linear buckets. A bucket is at most a quarter as wide as its lower bound,
+// so the error on a quantile stays within 25% whatever the scale, at a fixed
+// BUCKETS + 1 counters
+class Histogram {
+    public:
+        static constexpr size_t OCTAVES = 27;
+        static constexpr size_t SUB_BUCKET_BITS = 2;
+        static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = 1 + OCTAVES * SUB_BUCKETS;
+
+        void observe(std::chrono::nanoseconds duration);
+        // time elapsed since start
+        void observeSince(std::chrono::steady_clock::time_point start) {
+            observe(std::chrono::steady_clock::now() - start);
+        }
+
+        // inclusive upper bound of bucket i < BUCKETS in seconds
+        static double upperBound(size_t i);
+        // bucket i counts observations above the bound of bucket i - 1 and
+        // up to its own, the last one everything larger
+        uint64_t bucket(size_t i) const {
+            return m_buckets[i].load(std::memory_order_relaxed);
+        }
+        // total of all observations in ns
+        uint64_t sumNs() const {
+            return m_sumNs.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS + 1> m_buckets{};
+        std::atomic<uint64_t> m_sumNs{0};
+};
+
+// Process-wide registry of named metrics, rendered in the Prometheus text
+// exposition format for the /metrics endpoint.
+//
+// Metrics are registered once, usually when their owner is constructed, and
+// the returned references stay valid for the life of the process, so hot
+// paths only touch the metric itself. Registering an existing name returns
+// the same metric, registering it as another type throws std::logic_error.
+// Gauges are callbacks evaluated when the metrics are rendered, which keeps
+// values like queue depths off the paths that change them
+class Metrics {
+    public:
+        static Metrics& getInstance();
+
+        Counter& counter(const std::string& name, const std::string& help);
+        Histogram& histogram(const std::string& name, const std::string& help);
+        void gauge(const std::string& name, const std::string& help,
+                   std::function<double()> read);
+
+        // all metrics in the text exposition format
+        std::string render() const;
+
+    private:
+        enum class metricType { COUNTER, GAUGE, HISTOGRAM };
+        struct metric {
+                std::string name;
+                std::string help;
+                metricType type;
+                std::unique_ptr<Counter> counter;
+                std::unique_ptr<Histogram> histogram;
+                std::function<double()> read;
+        };
+
+        Metrics() = default;
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        // the metric registered as name, nullptr if there is none
+        metric* find(const std::string& name, metricType type);
+
+        mutable std::mutex m_mutex;
+        std::vector<metric> m_metrics;  // in registration order
+};
@@ -0,0 +1,117 @@
+#include "pipeline_trace.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
+#include <chrono>
+
+PipelineTrace::PipelineTrace()
+    : m_ipQueueWait(Metrics::getInstance().histogram(
+          "hovia_ip_queue_wait_seconds",
+          "Time a destination waited in the IP queue for a lookup thread")),
+      m_resultQueueWait(Metrics::getInstance().histogram(
+          "hovia_result_queue_wait_seconds",
+          "Time a result waited between the result queue and being sent")),
+      m_endToEnd(Metrics::getInstance().histogram(
+          "hovia_end_to_end_seconds",
+          "Time from a destination's first packet to its result being "
+          "sent")) {}
+
+PipelineTrace::~PipelineTrace() { close(); }
+
+bool PipelineTrace::open(const std::string& path, uint16_t samplePercent) {
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (m_file)
+        std::fclose(m_file);
+    m_file = nullptr;
+    m_path = path;
+    m_samplePercent.store(samplePercent);
+    return samplePercent == 0 || openFile();
+}
+
+bool PipelineTrace::setSamplePercent(uint16_t samplePercent) {
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_samplePercent.store(samplePercent);
+    // the file is only created once something is sampled, and kept when
+    // sampling is turned off again so the events already written survive
+    if (samplePercent == 0 || m_file || m_path.empty())
+        return true;
+    return openFile();
+}
+
+// truncates m_path and starts the event array, m_fileMutex must be held
+bool PipelineTrace::openFile() {
+    m_file = std::fopen(m_path.c_str(), "w");
+    if (!m_file)
+        return false;
+    std::fputs("[\n", m_file);
+    m_firstEvent = true;
+    return true;
+}
+
+void PipelineTrace::close() {
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_path.clear();
+    if (!m_file)
+        return;
+    std::fputs("\n]\n", m_file);
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+static void observeBetween(Histogram& histogram, int64_t from, int64_t to) {
+    if (from && to >= from)
+        histogram.observe(std::chrono::nanoseconds(to - from));
+}
+
+void PipelineTrace::record(const traceResult& result,
+                           const pipelineTimeline& t, int64_t sentNs) {
+    observeBetween(m_ipQueueWait, t.enqueued, t.dequeued);
+    observeBetween(m_resultQueueWait, t.resultQueued, sentNs);
+    // destinations restored by a warm start were never seen by this run
+    observeBetween(m_endToEnd, t.seen ? t.seen : t.enqueued, sentNs);
+
+    if (m_samplePercent.load(std::memory_order_relaxed) &&
+        sampled(result.dest_info.ip))
+        writeEvents(result, t, sentNs);
+}
+
+// the same destinations are always picked, so a sampled one is traced on
+// every pass through the pipeline
+bool PipelineTrace::sampled(uint32_t ip) const {
+    const uint32_t hash = ip * 2654435761u;
+    return (hash >> 16) % 100 <
+           m_samplePercent.load(std::memory_order_relaxed);
+}
+
+void PipelineTrace::writeEvents(const traceResult& result,
+                                const pipelineTimeline& t, int64_t sentNs) {
+    const uint32_t ip = result.dest_info.ip;
+    const std::string ipStr = ipToStr(ip);
+
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    if (!m_file)
+        return;
+
+    // label the destination's row with its address
+    std::fprintf(m_file,
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 m_firstEvent ? "" : ",\n", ip, ipStr.c_str());
+    m_firstEvent = false;
+
+    // one complete event per stage, timestamps in microseconds
+    auto stage = [&](const char* name, int64_t from, int64_t to) {
+        if (!from || to < from)
+            return;
+        std::fprintf(m_file,
+                     ",\n{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\","
+                     "\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"args\":{\"ip\":\"%s\"}}",
+                     name, ip, static_cast<double>(from) / 1e3,
+                     static_cast<double>(to - from) / 1e3, ipStr.c_str());
+    };
+    stage("capture", t.seen, t.enqueued);
+    stage("ip queue", t.enqueued, t.dequeued);
+    stage("traceroute", t.traceStart, t.traceEnd);
+    stage("lookup", t.lookupStart, t.lookupEnd);
+    stage("result queue", t.resultQueued, sentNs);
+    std::fflush(m_file);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "metrics/metrics.hpp"
+#include "utils/common_structs.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+// Collects the timeline of every result once it has been sent. Each
+// stage's latency goes to a histogram on /metrics, and a sampled percentage
+// of destinations is written to a file as Chrome trace events, one row per
+// destination, to be opened in chrome://tracing or Perfetto.
+//
+// The file uses the JSON array format and is flushed as it grows, so a trace
+// cut short by a crash still loads
+class PipelineTrace {
+    public:
+        PipelineTrace();
+        ~PipelineTrace();
+
+        // starts writing sampled timelines to path, truncating it. A
+        // samplePercent of 0 only keeps the histograms
+        bool open(const std::string& path, uint16_t samplePercent);
+        // changes the sampled percentage while open, creating the file if
+        // sampling was off until now
+        bool setSamplePercent(uint16_t samplePercent);
+        void close();
+
+        // records a result's timeline, sentNs being the Clock::monotonicNs()
+        // reading taken when it went out to the clients
+        void record(const traceResult& result, const pipelineTimeline& t,
+                    int64_t sentNs);
+
+    private:
+        bool sampled(uint32_t ip) const;
+        bool openFile();
+        void writeEvents(const traceResult& result, const pipelineTimeline& t,
+                         int64_t sentNs);
+
+        Histogram& m_ipQueueWait;
+        Histogram& m_resultQueueWait;
+        Histogram& m_endToEnd;
+
+        // guards the file, its path and m_firstEvent
+        std::mutex m_fileMutex;
+        std::string m_path;  // empty while closed
+        std::FILE* m_file = nullptr;
+        bool m_firstEvent = true;
+        std::atomic<uint16_t> m_samplePercent{0};
+};
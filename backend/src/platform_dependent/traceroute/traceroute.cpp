@@ -1,9 +1,10 @@
 #include "traceroute.hpp"
 #include "utils/logger/logger.hpp"
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <sys/socket.h>
-#include <vector>
+#include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -29,25 +30,76 @@ unsigned short checksum(void *data, int len) {
     return ~sum;
 }
 
-std::vector<hopInfo> traceroute(const std::string targetIP, int maxHops,
-                                uint32_t timeoutMS) {
-    std::vector<hopInfo> hops;
-    hops.reserve(static_cast<size_t>(
-        maxHops / 1.5));  // reserve some space for the hops vector to avoid
-                          // many reallocations
+// Checks whether the packet in buf, as read from a raw ICMP socket, answers
+// the echo request with the given id and seq sent to dst: either the echo
+// reply itself or an error quoting the request. Every raw ICMP socket
+// receives a copy of every ICMP packet, so this is what keeps traces running
+// in parallel from taking each other's hops
+static bool answersProbe(const char *buf, size_t len, uint16_t id,
+                         uint16_t seq, in_addr_t dst) {
+    struct ip outer;
+    if (len < sizeof(outer))
+        return false;
+    memcpy(&outer, buf, sizeof(outer));
+    size_t offset = outer.ip_hl * 4;
+
+    struct icmp reply;
+    if (len < offset + ICMP_MINLEN)
+        return false;
+    memcpy(&reply, buf + offset, ICMP_MINLEN);
+    if (reply.icmp_type == ICMP_ECHOREPLY)
+        return reply.icmp_id == id && reply.icmp_seq == seq;
+    if (reply.icmp_type != ICMP_TIMXCEED && reply.icmp_type != ICMP_UNREACH)
+        return false;
+
+    // errors quote the IP header and the first 8 bytes of the probe
+    offset += ICMP_MINLEN;
+    struct ip quoted;
+    if (len < offset + sizeof(quoted))
+        return false;
+    memcpy(&quoted, buf + offset, sizeof(quoted));
+    offset += quoted.ip_hl * 4;
+    if (quoted.ip_p != IPPROTO_ICMP || quoted.ip_dst.s_addr != dst ||
+        len < offset + ICMP_MINLEN)
+        return false;
+
+    struct icmp probe;
+    memcpy(&probe, buf + offset, ICMP_MINLEN);
+    return probe.icmp_type == ICMP_ECHO && probe.icmp_id == id &&
+           probe.icmp_seq == seq;
+}
+
+// milliseconds from now until deadline, 0 once it has passed
+static long remainingMs(const struct timeval &deadline) {
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+    const long ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+                    (deadline.tv_usec - now.tv_usec) / 1000;
+    return ms > 0 ? ms : 0;
+}
+
+hopList traceroute(const std::string targetIP, int maxHops,
+                   uint32_t timeoutMS) {
+    hopList hops;
+    // hops are stored inline, never probe further than they can hold
+    if (maxHops > static_cast<int>(MAX_HOPS))
+        maxHops = static_cast<int>(MAX_HOPS);
     int sockfd;
     struct sockaddr_in dest_addr;
-    struct hostent *host;
 
-    if ((host = gethostbyname(targetIP.c_str())) == nullptr) {
+    // getaddrinfo() rather than gethostbyname(), several lookup threads
+    // trace at once
+    struct addrinfo hints, *resolved = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    if (getaddrinfo(targetIP.c_str(), nullptr, &hints, &resolved) != 0 ||
+        !resolved) {
         Logger::getInstance().log(LogLevel::ERROR, __func__,
                                   "Unable to resolve hostname");
         return {};
     }
-
-    memset(&dest_addr, 0, sizeof(dest_addr));
-    dest_addr.sin_family = AF_INET;
-    memcpy(&dest_addr.sin_addr, host->h_addr, host->h_length);
+    memcpy(&dest_addr, resolved->ai_addr, sizeof(dest_addr));
+    freeaddrinfo(resolved);
 
     // create a raw socket to send the ICMP packets
     if ((sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP)) < 0) {
@@ -55,6 +107,11 @@ std::vector<hopInfo> traceroute(const std::string targetIP, int maxHops,
         return {};
     }
 
+    // an echo id of its own for every trace, the process id alone is shared
+    // by all of them
+    static std::atomic<uint16_t> nextId{static_cast<uint16_t>(getpid())};
+    const uint16_t id = nextId.fetch_add(1, std::memory_order_relaxed);
+
     struct sockaddr_in recv_addr;
     socklen_t recv_addr_len = sizeof(recv_addr);
     char recv_buffer[512];  // ICMP reply buffer
@@ -72,44 +129,62 @@ std::vector<hopInfo> traceroute(const std::string targetIP, int maxHops,
         memset(&icmp_packet, 0, sizeof(icmp_packet));
         icmp_packet.icmp_type = ICMP_ECHO;
         icmp_packet.icmp_code = 0;
-        icmp_packet.icmp_id = getpid();
+        icmp_packet.icmp_id = id;
         icmp_packet.icmp_seq = ttl;
         icmp_packet.icmp_cksum = checksum(&icmp_packet, sizeof(icmp_packet));
 
-        struct timeval start_time, end_time;
+        struct timeval start_time, end_time, deadline;
         gettimeofday(&start_time, nullptr);
+        deadline = start_time;
+        deadline.tv_sec += timeoutMS / 1000;
+        deadline.tv_usec += (timeoutMS % 1000) * 1000;
+        if (deadline.tv_usec >= 1000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_usec -= 1000000;
+        }
 
         if (sendto(sockfd, &icmp_packet, sizeof(icmp_packet), 0,
                    (struct sockaddr *)&dest_addr, sizeof(dest_addr)) <= 0) {
             continue;
         }
 
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(sockfd, &fds);
-        struct timeval timeout;
-        timeout.tv_sec = timeoutMS / 1000;
-        timeout.tv_usec = (timeoutMS % 1000) * 1000;
+        // replies to other probes are skipped until this one's arrives or
+        // its timeout runs out
+        bool answered = false;
+        for (long left = timeoutMS; !answered && left > 0;
+             left = remainingMs(deadline)) {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(sockfd, &fds);
+            struct timeval timeout;
+            timeout.tv_sec = left / 1000;
+            timeout.tv_usec = (left % 1000) * 1000;
+            if (select(sockfd + 1, &fds, nullptr, nullptr, &timeout) <= 0)
+                break;
+            recv_addr_len = sizeof(recv_addr);
+            const ssize_t got =
+                recvfrom(sockfd, recv_buffer, sizeof(recv_buffer), 0,
+                         (struct sockaddr *)&recv_addr, &recv_addr_len);
+            answered = got > 0 &&
+                       answersProbe(recv_buffer, static_cast<size_t>(got), id,
+                                    static_cast<uint16_t>(ttl),
+                                    dest_addr.sin_addr.s_addr);
+        }
+        if (!answered)
+            continue;
 
+        gettimeofday(&end_time, nullptr);
         hopInfo hop{};
-        if (select(sockfd + 1, &fds, nullptr, nullptr, &timeout) > 0) {
-            if (recvfrom(sockfd, recv_buffer, sizeof(recv_buffer), 0,
-                         (struct sockaddr *)&recv_addr, &recv_addr_len) > 0) {
-                gettimeofday(&end_time, nullptr);
-
-                inet_ntop(AF_INET, &recv_addr.sin_addr, hop.hopIP,
-                          sizeof(hop.hopIP));
-                // calculate latency in milliseconds
-                hop.latency = (end_time.tv_sec - start_time.tv_sec) * 1000.0 +
-                              (end_time.tv_usec - start_time.tv_usec) / 1000.0;
-                // if the reply came from the destination IP, stop the
-                // traceroute early
-                if (recv_addr.sin_addr.s_addr == dest_addr.sin_addr.s_addr) {
-                    break;
-                }
-                hops.push_back(hop);
-            }
-        }
+        hop.hopIP = ntohl(recv_addr.sin_addr.s_addr);
+        // calculate latency in milliseconds
+        hop.latency = static_cast<float>(
+            (end_time.tv_sec - start_time.tv_sec) * 1000.0 +
+            (end_time.tv_usec - start_time.tv_usec) / 1000.0);
+        // if the reply came from the destination IP, stop the traceroute
+        // early
+        if (recv_addr.sin_addr.s_addr == dest_addr.sin_addr.s_addr)
+            break;
+        hops.push_back(hop);
     }
     close(sockfd);  // close the socket before returning
     return hops;    // return collected hops
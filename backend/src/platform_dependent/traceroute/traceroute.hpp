@@ -1,9 +1,10 @@
 #include <cstdint>
-#include <vector>
+#include <string>
 #include "utils/common_structs.hpp"
 
 // ICMP checksum function
 unsigned short checksum(void* data, int len);
 
-std::vector<hopInfo> traceroute(const std::string targetIP, int maxHops,
-                                uint32_t timeoutMS);
+// probes at most min(maxHops, MAX_HOPS) TTLs
+hopList traceroute(const std::string targetIP, int maxHops,
+                   uint32_t timeoutMS);
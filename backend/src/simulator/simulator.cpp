@@ -0,0 +1,141 @@
+#include "simulator.hpp"
+#include "utils/ip_utils/ip_utils.hpp"
+#include "utils/string_pool/string_pool.hpp"
+#include <algorithm>
+#include <random>
+#include <thread>
+
+RateLimiter::RateLimiter(uint32_t rate)
+    : m_rate(rate), m_tokens(rate), m_last(std::chrono::steady_clock::now()) {}
+
+bool RateLimiter::tryAcquire() {
+    if (m_rate == 0)
+        return true;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_last).count();
+    m_last = now;
+    m_tokens = std::min<double>(m_rate, m_tokens + elapsed * m_rate);
+    if (m_tokens < 1)
+        return false;
+    m_tokens -= 1;
+    return true;
+}
+
+// stable hash of a value and a salt, used to derive the topology
+static uint32_t mix(uint32_t value, uint32_t salt) {
+    uint32_t h = value * 0x9E3779B1u ^ salt * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+// jitter and loss draws, one generator per lookup thread
+static double uniform() {
+    thread_local std::mt19937 rng{std::random_device{}()};
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+}
+
+static void sleepMs(double ms) {
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+// router answering the probe with the given TTL on the way to dst
+static uint32_t routerAt(uint32_t dst, int hop, int hopCount) {
+    if (hop == 1)
+        return 0xC0A80101;  // 192.168.1.1, the home gateway
+    if (hop == 2)
+        return 0x0A000001;  // 10.0.0.1, the ISP edge
+    if (hop <= hopCount / 2)
+        // core routers in 100.64.0.0/10, shared by the whole /8
+        return 0x64400000 | (mix(dst >> 24, hop) & 0x003FFFFF);
+    // routers close to the destination sit in its own network
+    const uint32_t key = hop >= hopCount - 2 ? dst >> 8 : dst >> 16;
+    return (dst & 0xFFFF0000) | (mix(key, hop) & 0xFFFF);
+}
+
+SimulatedTrace::SimulatedTrace(const simConfig& config)
+    : m_config(config), m_icmpLimit(config.icmpRate) {}
+
+hopList SimulatedTrace::trace(const std::string& ip, int maxHops,
+                              uint32_t timeoutMs) {
+    hopList hops;
+    uint32_t dst;
+    if (!parseIp(ip, dst))
+        return hops;
+
+    // destinations in the same /24 are the same distance away, the final
+    // probe is answered by the destination itself
+    const int hopCount = 6 + static_cast<int>(mix(dst >> 8, 0) % 12);
+    const int probes = std::min<int>(
+        hopCount, std::min<int>(maxHops, static_cast<int>(MAX_HOPS)));
+
+    for (int hop = 1; hop <= probes; ++hop) {
+        const bool lost = uniform() * 100 < m_config.lossPercent ||
+                          !m_icmpLimit.tryAcquire();
+        if (lost) {
+            sleepMs(timeoutMs);
+            continue;
+        }
+        const double rtt =
+            hop * m_config.hopLatencyMs * (0.9 + 0.2 * uniform());
+        sleepMs(rtt);
+        if (hop == hopCount)
+            break;  // the destination answered
+        hops.push_back({routerAt(dst, hop, hopCount), static_cast<float>(rtt)});
+    }
+    return hops;
+}
+
+SimulatedGeo::SimulatedGeo(const simConfig& config)
+    : m_config(config), m_limit(config.geoRate) {}
+
+namespace {
+struct simCountry {
+        const char* name;
+        const char* timeZone;
+        double latitude, longitude;
+};
+
+constexpr simCountry COUNTRIES[] = {
+    {"United States", "America/New_York", 39.0, -77.5},
+    {"Germany", "Europe/Berlin", 50.1, 8.7},
+    {"Netherlands", "Europe/Amsterdam", 52.4, 4.9},
+    {"United Kingdom", "Europe/London", 51.5, -0.1},
+    {"Japan", "Asia/Tokyo", 35.7, 139.7},
+    {"Singapore", "Asia/Singapore", 1.3, 103.8},
+    {"Brazil", "America/Sao_Paulo", -23.5, -46.6},
+    {"Australia", "Australia/Sydney", -33.9, 151.2},
+};
+}  // namespace
+
+// country by /8 and network by /16, so the data is the same for an address on
+// every lookup and realistic in how often it repeats
+destInfo SimulatedGeo::lookup(const std::string& ip) {
+    sleepMs(m_config.geoLatencyMs * (0.8 + 0.4 * uniform()));
+
+    destInfo info{};
+    uint32_t addr;
+    if (!parseIp(ip, addr) || !m_limit.tryAcquire())
+        return info;
+
+    StringPool& pool = StringPool::getInstance();
+    const simCountry& country =
+        COUNTRIES[mix(addr >> 24, 1) % std::size(COUNTRIES)];
+    const uint32_t network = mix(addr >> 16, 2) % 1000;
+    const std::string netName = "Sim Net " + std::to_string(network);
+
+    info.ip = addr;
+    info.country = pool.intern(country.name);
+    info.region = pool.intern("Region " + std::to_string(network % 20));
+    info.isp = pool.intern(netName);
+    info.org = pool.intern(netName);
+    info.asn = 64512 + network;
+    info.as = pool.intern("AS" + std::to_string(info.asn) + " " + netName);
+    info.asname = pool.intern("SIMNET-" + std::to_string(network));
+    info.latitude = country.latitude + (mix(addr >> 8, 3) % 200) / 100.0 - 1;
+    info.longitude = country.longitude + (mix(addr >> 8, 4) % 200) / 100.0 - 1;
+    info.time_zone = pool.intern(country.timeZone);
+    return info;
+}
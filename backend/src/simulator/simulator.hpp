@@ -0,0 +1,60 @@
+#pragma once
+#include "lookup/backend.hpp"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// knobs of the simulated network
+struct simConfig {
+        double hopLatencyMs = 5;  // round trip added by every hop
+        double lossPercent = 2;   // chance a hop does not answer a probe
+        // replies per second the routers send across all traces before
+        // they start dropping probes, 0 for no limit
+        uint32_t icmpRate = 0;
+        double geoLatencyMs = 30;  // response time of the geolocation service
+        // lookups per second the geolocation service answers, the rest
+        // fail as ip-api.com's do past its quota. 0 for no limit
+        uint32_t geoRate = 0;
+};
+
+// token bucket holding up to one second's worth of tokens
+class RateLimiter {
+    public:
+        explicit RateLimiter(uint32_t rate);
+        bool tryAcquire();
+
+    private:
+        std::mutex m_mutex;
+        const uint32_t m_rate;  // 0 never limits
+        double m_tokens;
+        std::chrono::steady_clock::time_point m_last;
+};
+
+// Traceroute over a synthetic topology derived from the destination address:
+// every trace leaves through the same gateway and ISP edge, destinations in
+// the same /8 share core routers and those in the same /16 and /24 their
+// last hops, so routes overlap the way real ones do. Probes take real time,
+// the hop's round trip or the timeout for a lost one, so lookup threads are
+// kept as busy as by traceroute()
+class SimulatedTrace : public TraceBackend {
+    public:
+        explicit SimulatedTrace(const simConfig& config);
+        hopList trace(const std::string& ip, int maxHops,
+                      uint32_t timeoutMs) override;
+
+    private:
+        const simConfig m_config;
+        RateLimiter m_icmpLimit;
+};
+
+// Local stand-in for ip-api.com, answering with made up but stable data for
+// each address after the configured latency
+class SimulatedGeo : public GeoBackend {
+    public:
+        explicit SimulatedGeo(const simConfig& config);
+        destInfo lookup(const std::string& ip) override;
+
+    private:
+        const simConfig m_config;
+        RateLimiter m_limit;
+};
@@ -0,0 +1,94 @@
+#include "clock.hpp"
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+Clock& Clock::getInstance() {
+    static Clock instance;
+    return instance;
+}
+
+Clock::Clock() {
+    refresh();
+    m_ticker = std::thread(&Clock::tickLoop, this);
+}
+
+Clock::~Clock() {
+    {
+        std::lock_guard<std::mutex> lock(m_tickMutex);
+        m_stopping = true;
+    }
+    m_tickCond.notify_one();
+    if (m_ticker.joinable())
+        m_ticker.join();
+}
+
+int64_t Clock::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t Clock::nowMs() { return nowNs() / 1000000; }
+
+int64_t Clock::monotonicNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// formats the current second and publishes it, only called from the
+// constructor and the ticker thread
+void Clock::refresh() {
+    const std::time_t now = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+    std::tm local;
+    localtime_r(&now, &local);
+    char text[sizeof(m_words)] = {};
+    std::strftime(text, sizeof(text), "%F %T", &local);
+
+    uint64_t words[3];
+    std::memcpy(words, text, sizeof(words));
+    const uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < m_words.size(); ++i)
+        m_words[i].store(words[i], std::memory_order_relaxed);
+    m_seq.store(seq + 2, std::memory_order_release);
+}
+
+void Clock::tickLoop() {
+    std::unique_lock<std::mutex> lock(m_tickMutex);
+    while (!m_stopping) {
+        // wake just after the next second boundary
+        const auto now = std::chrono::system_clock::now();
+        const auto next =
+            std::chrono::time_point_cast<std::chrono::seconds>(now) +
+            std::chrono::seconds(1);
+        if (m_tickCond.wait_until(lock, next, [this] { return m_stopping; }))
+            break;
+        refresh();
+    }
+}
+
+void Clock::appendTimestamp(std::string& out) const {
+    uint64_t words[3];
+    uint32_t before, after;
+    do {
+        before = m_seq.load(std::memory_order_acquire);
+        for (size_t i = 0; i < m_words.size(); ++i)
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    char text[sizeof(words)];
+    std::memcpy(text, words, sizeof(words));
+    out.append(text, TIMESTAMP_LEN);
+}
+
+std::string Clock::timestamp() const {
+    std::string out;
+    appendTimestamp(out);
+    return out;
+}
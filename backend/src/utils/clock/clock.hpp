@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Process-wide wall clock. The formatted local time used by log lines is
+// kept in a cache that a background thread refreshes on every second
+// boundary, so callers never go through localtime() and its global lock.
+// Raw epoch readings go straight to system_clock, which is a vDSO call.
+class Clock {
+    public:
+        static Clock& getInstance();
+        ~Clock();
+
+        // unix epoch in nanoseconds / milliseconds
+        static int64_t nowNs();
+        static int64_t nowMs();
+        // steady clock in nanoseconds, for measuring intervals
+        static int64_t monotonicNs();
+
+        // appends the local time as "YYYY-MM-DD HH:MM:SS", at most a second
+        // old. Lock-free
+        void appendTimestamp(std::string& out) const;
+        std::string timestamp() const;
+
+    private:
+        static constexpr size_t TIMESTAMP_LEN = 19;
+
+        Clock();
+        Clock(const Clock&) = delete;
+        Clock& operator=(const Clock&) = delete;
+
+        void refresh();
+        void tickLoop();
+
+        // the formatted text packed into words, published under a seqlock
+        // (odd m_seq while a refresh is in progress)
+        std::atomic<uint32_t> m_seq{0};
+        std::array<std::atomic<uint64_t>, 3> m_words{};
+
+        std::mutex m_tickMutex;
+        std::condition_variable m_tickCond;
+        bool m_stopping = false;
+        std::thread m_ticker;
+};
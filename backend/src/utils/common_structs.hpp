@@ -1,23 +1,74 @@
 // common.hpp
 #pragma once
-#include <string>
-#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// upper bound on the number of hops stored inline in a traceResult,
+// traceroute() never probes past this TTL regardless of the maxHops setting
+constexpr std::size_t MAX_HOPS = 32;
+
+// id handed out by the StringPool, 0 is always the empty string
+using stringId = std::uint32_t;
 
 struct hopInfo {
-        char hopIP[16];
-        double latency;
+        uint32_t hopIP = 0;    // host byte order
+        float latency = 0.0f;  // milliseconds
+};
+
+// fixed-capacity, inline replacement for std::vector<hopInfo> so that a
+// traceResult never touches the heap
+struct hopList {
+        std::array<hopInfo, MAX_HOPS> items{};
+        uint8_t count = 0;
+
+        // returns false once the list is full, the hop is then discarded
+        bool push_back(const hopInfo& hop) {
+            if (count >= MAX_HOPS)
+                return false;
+            items[count++] = hop;
+            return true;
+        }
+
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const hopInfo* begin() const { return items.data(); }
+        const hopInfo* end() const { return items.data() + count; }
 };
 
+// every string field is an id into the StringPool, since the same countries,
+// ISPs and AS names repeat across almost every result
 struct destInfo {
-        char ip[16];
-        std::string country, region, isp, org, as, asname;
+        uint32_t ip = 0;  // host byte order
+        stringId country = 0, region = 0, isp = 0, org = 0, as = 0, asname = 0;
+        uint32_t asn = 0;  // numeric part of as ("AS15169 ..."), 0 if unknown
         double latitude = 0.0;
         double longitude = 0.0;
-        std::string time_zone;
+        stringId time_zone = 0;
+};
+
+// steady clock readings (Clock::monotonicNs) taken as a destination moves
+// through the pipeline, 0 for stages it skipped. It travels beside the result
+// up to the API and is dropped once sent, so the history, replay buffer and
+// journal never hold it
+struct pipelineTimeline {
+        int64_t seen = 0;      // first packet, in Capture::packetHandler
+        int64_t enqueued = 0;  // pushed to the IP queue
+        int64_t dequeued = 0;  // taken by a lookup thread
+        int64_t traceStart = 0, traceEnd = 0;
+        int64_t lookupStart = 0, lookupEnd = 0;
+        int64_t resultQueued = 0;  // pushed to the result queue
 };
 
 struct traceResult {
-        std::string timestamp;
+        int64_t timestamp_ns = 0;  // unix epoch, nanoseconds
         destInfo dest_info;
-        std::vector<hopInfo> hops;
+        hopList hops;
+
+        int64_t timestampMs() const { return timestamp_ns / 1000000; }
 };
+
+// results are passed between threads by value, keep them plain data
+static_assert(std::is_trivially_copyable<traceResult>::value,
+              "traceResult must stay trivially copyable");
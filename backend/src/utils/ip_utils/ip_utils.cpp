@@ -0,0 +1,76 @@
+#include "ip_utils.hpp"
+#include <arpa/inet.h>
+#include <cstdio>
+
+std::string ipToStr(uint32_t ip) {
+    std::string out;
+    appendIp(out, ip);
+    return out;
+}
+
+void appendIp(std::string& out, uint32_t ip) {
+    char buf[16];
+    char* p = buf;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        unsigned octet = (ip >> shift) & 0xFF;
+        if (octet >= 100)
+            *p++ = static_cast<char>('0' + octet / 100);
+        if (octet >= 10)
+            *p++ = static_cast<char>('0' + (octet / 10) % 10);
+        *p++ = static_cast<char>('0' + octet % 10);
+        if (shift)
+            *p++ = '.';
+    }
+    out.append(buf, p);
+}
+
+std::string decodeIP(uint32_t ip) {
+    // If ip is in host byte order, convert to network order:
+    uint32_t net_ip = htonl(ip);
+
+    in_addr addr;
+    addr.s_addr = net_ip;
+
+    char buf[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &addr, buf, sizeof(buf)) != nullptr) {
+        return buf;
+    } else {
+        std::perror("inet_ntop");
+        return "error occured";
+    }
+}
+
+bool parseIp(const std::string& str, uint32_t& ip) {
+    in_addr addr{};
+    if (inet_pton(AF_INET, str.c_str(), &addr) != 1)
+        return false;
+    ip = ntohl(addr.s_addr);
+    return true;
+}
+
+bool parseCidr(const std::string& str, uint32_t& network, uint32_t& mask) {
+    std::string addrPart = str;
+    int prefix = 32;
+    size_t slash = str.find('/');
+    if (slash != std::string::npos) {
+        addrPart = str.substr(0, slash);
+        try {
+            size_t used = 0;
+            prefix = std::stoi(str.substr(slash + 1), &used);
+            if (used != str.size() - slash - 1)
+                return false;
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (prefix < 0 || prefix > 32)
+            return false;
+    }
+
+    uint32_t ip;
+    if (!parseIp(addrPart, ip))
+        return false;
+
+    mask = prefix == 0 ? 0 : ~uint32_t{0} << (32 - prefix);
+    network = ip & mask;
+    return true;
+}
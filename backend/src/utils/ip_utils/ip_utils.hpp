@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Converts a uint32_t IP (in host byte order) to dotted-decimal string
+std::string ipToStr(uint32_t ip);
+
+// Appends the dotted-decimal form of ip (host byte order) to out without any
+// intermediate allocation
+void appendIp(std::string& out, uint32_t ip);
+
+// Same as ipToStr, through inet_ntop()
+std::string decodeIP(uint32_t ip);
+
+// Parses a dotted-decimal address into host byte order, returns false if str
+// is not a valid IPv4 address
+bool parseIp(const std::string& str, uint32_t& ip);
+
+// Parses "a.b.c.d/len" (or a bare address, taken as /32) into a network and
+// mask in host byte order
+bool parseCidr(const std::string& str, uint32_t& network, uint32_t& mask);
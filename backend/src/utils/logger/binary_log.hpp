@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Binary log format, shared by the Logger's binary sink and hovia-logdecode.
+//
+// The file is a sequence of records, in host byte order:
+//   uint16 body length, uint8 record type, body
+//
+//   RUN     int64 unix epoch ns the process started at
+//           starts the records of one process, the file is appended to
+//           across restarts. Format ids and cycle counters only hold
+//           within a run
+//   FORMAT  uint32 format id, uint8 level, string function, string format
+//           defines a LOG_* call site, written before the first entry that
+//           uses it in each file
+//   ENTRY   uint32 format id, uint8 level, uint64 cycle counter, arguments
+//           each argument is a uint8 tag followed by its value. Format id 0
+//           is a preformatted Logger::log() line whose arguments are the
+//           function name and the message
+//   SYNC    uint64 cycle counter, int64 unix epoch ns
+//           pairs the raw counter with wall time so the decoder can convert
+//           entry timestamps
+//   DROPPED uint64 number of lines dropped because the log fell behind
+//
+// strings are a uint16 length followed by the bytes, those longer than
+// MAX_STRING are cut short and end in TRUNCATED
+namespace binlog {
+
+enum recordType : uint8_t { FORMAT = 1, ENTRY = 2, SYNC = 3, DROPPED = 4,
+                            RUN = 5 };
+enum argTag : uint8_t { INT = 1, UINT = 2, DOUBLE = 3, STRING = 4, CHAR = 5,
+                        BOOL = 6 };
+
+constexpr size_t RECORD_HEADER = sizeof(uint16_t) + sizeof(uint8_t);
+constexpr size_t MAX_STRING = 4096;
+constexpr std::string_view TRUNCATED = "...[truncated]";
+
+// raw timestamp for entries: the TSC where available, steady_clock otherwise
+inline uint64_t cycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+template <typename T>
+inline void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void putString(std::string& out, std::string_view str) {
+    if (str.size() <= MAX_STRING) {
+        put(out, static_cast<uint16_t>(str.size()));
+        out.append(str.data(), str.size());
+        return;
+    }
+    put(out, static_cast<uint16_t>(MAX_STRING));
+    out.append(str.data(), MAX_STRING - TRUNCATED.size());
+    out.append(TRUNCATED);
+}
+
+// starts a record in out, finishRecord() fills in its length
+inline void beginRecord(std::string& out, recordType type) {
+    out.append(sizeof(uint16_t), '\0');
+    put(out, static_cast<uint8_t>(type));
+}
+
+// returns false if the record is too long to be stored
+inline bool finishRecord(std::string& out, size_t start) {
+    const size_t body = out.size() - start - RECORD_HEADER;
+    if (body > UINT16_MAX)
+        return false;
+    const uint16_t len = static_cast<uint16_t>(body);
+    std::memcpy(&out[start], &len, sizeof(len));
+    return true;
+}
+
+inline void putArg(std::string& out, std::string_view value) {
+    put(out, STRING);
+    putString(out, value);
+}
+inline void putArg(std::string& out, const char* value) {
+    putArg(out, std::string_view(value));
+}
+inline void putArg(std::string& out, char value) {
+    put(out, CHAR);
+    put(out, value);
+}
+inline void putArg(std::string& out, bool value) {
+    put(out, BOOL);
+    put(out, static_cast<uint8_t>(value));
+}
+template <typename T>
+inline std::enable_if_t<std::is_arithmetic_v<T>> putArg(std::string& out,
+                                                        T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        put(out, DOUBLE);
+        put(out, static_cast<double>(value));
+    } else if constexpr (std::is_signed_v<T>) {
+        put(out, INT);
+        put(out, static_cast<int64_t>(value));
+    } else {
+        put(out, UINT);
+        put(out, static_cast<uint64_t>(value));
+    }
+}
+
+}  // namespace binlog
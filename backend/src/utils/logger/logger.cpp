@@ -1,54 +1,122 @@
 #include "logger.hpp"
+#include "utils/clock/clock.hpp"
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <cstring>
+#include <cctype>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
-#include <stdexcept>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef HOVIA_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 std::shared_ptr<Logger> LOGGER;
 
+static const std::string FALLBACK_LOG_PATH = "app.log";
+// flush interval used until configure() is called
+constexpr uint16_t DEFAULT_FLUSH_INTERVAL_MS = 100;
+constexpr size_t MIB = 1 << 20;
+
 Logger& Logger::getInstance() {
     static Logger instance;
     return instance;
 }
 
-void Logger::openLogStream(const std::string& logPath) {
-    if (m_currentLogPath == logPath && m_logStream.is_open()) {
-        // Same file already open, no action needed.
-        return;
+Logger::Logger()
+    : m_startCounter(binlog::cycleCounter()), m_startNs(Clock::nowNs()) {
+    m_flusher = std::thread(&Logger::flusherLoop, this);
+    m_archiver = std::thread(&Logger::archiverLoop, this);
+}
+
+Logger::~Logger() {
+    // the archiver finishes its queue first, so the flusher still writes out
+    // whatever it logs
+    {
+        std::lock_guard<std::mutex> lock(m_archiveMutex);
+        m_archiveStopping = true;
+    }
+    m_archiveCond.notify_one();
+    if (m_archiver.joinable())
+        m_archiver.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
     }
+    m_wakeCond.notify_one();
+    if (m_flusher.joinable())
+        m_flusher.join();
+    if (m_fd >= 0)
+        ::close(m_fd);
 
-    // Close current file if open
-    if (m_logStream.is_open()) {
-        m_logStream.flush();
-        m_logStream.close();
+    // a rotation done by the final drain, with no thread left to log through
+    for (const auto& [rotated, livePath] : m_archiveQueue) {
+        if (!archive(rotated, livePath) && !m_binary.load())
+            writeSync(livePath, "[" + getCurrentTimestamp() +
+                                    "] [WARNING] [Logger::~Logger()]: "
+                                    "Failed to compress rotated log " +
+                                    rotated + "\n");
     }
+}
+
+void Logger::configure(std::shared_ptr<Settings> pSettings) {
+    const bool binary = pSettings && pSettings->getBinaryLog();
+    // lines already queued belong to the old sink
+    if (binary != m_binary.load())
+        flush();
+    m_settingsRaw.store(pSettings.get());
+    std::atomic_store(&m_pSettings, std::move(pSettings));
+    m_binary.store(binary);
+}
 
-    // Open new log file
-    m_logStream.open(logPath, std::ios::app);
-    if (!m_logStream) {
-        throw std::runtime_error("Failed to open log file: " + logPath);
+std::string Logger::defaultPath() const {
+    std::shared_ptr<Settings> settings = std::atomic_load(&m_pSettings);
+    if (settings) {
+        std::string path = settings->getLogPath();
+        if (!path.empty())
+            return path;
     }
-    m_currentLogPath = logPath;
+    return FALLBACK_LOG_PATH;
+}
+
+// Appends a complete line, or nothing if it does not fit. Lines only become
+// visible to the flusher once the tail is published
+bool Logger::logRing::push(const char* line, size_t len) {
+    const size_t tailPos = tail.load(std::memory_order_relaxed);
+    const size_t headPos = head.load(std::memory_order_acquire);
+    if (CAPACITY - (tailPos - headPos) < len)
+        return false;
+
+    const size_t start = tailPos & (CAPACITY - 1);
+    const size_t first = std::min(len, CAPACITY - start);
+    std::memcpy(data.get() + start, line, first);
+    std::memcpy(data.get(), line + first, len - first);
+    tail.store(tailPos + len, std::memory_order_release);
+    return true;
 }
 
-void Logger::closeLogStream() {
-    if (m_logStream.is_open()) {
-        m_logStream.flush();
-        m_logStream.close();
-        m_currentLogPath.clear();
+Logger::logRing& Logger::threadRing() const {
+    thread_local std::shared_ptr<logRing> ring;
+    if (!ring) {
+        ring = std::make_shared<logRing>();
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(ring);
     }
+    return *ring;
 }
 
 std::string Logger::getCurrentTimestamp() const {
-    auto now = std::chrono::system_clock::now();
-    auto t_c = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&t_c), "%F %T");
-    return ss.str();
+    return Clock::getInstance().timestamp();
 }
 
-std::string Logger::levelToString(const LogLevel level) {
+const char* Logger::levelToString(const LogLevel level) {
     switch (level) {
         case DEBUG:
             return "DEBUG";
@@ -65,65 +133,482 @@ std::string Logger::levelToString(const LogLevel level) {
     }
 }
 
+std::string& Logger::beginLine(const LogLevel level,
+                               std::string_view functionName) const {
+    thread_local std::string line;
+    line.clear();
+    line.push_back('[');
+    Clock::getInstance().appendTimestamp(line);
+    line.append("] [");
+    line.append(levelToString(level)).append("] [");
+    line.append(functionName).append("()]: ");
+    return line;
+}
+
 void Logger::log(const LogLevel level, const std::string& functionName,
                  const std::string& message, const std::string& logPath) const {
-    static const std::string fallbackLogPath = "app.log";
-
-    // ensures concurrent access to the log stream
-    std::lock_guard<std::mutex> lock(m_logMutex);
-    std::ostream* outStream = nullptr;
-
-    // Determine default path safely: if m_pSettings is not initialized, use
-    // fallback path
-    const std::string defaultPath =
-        (m_pSettings && !m_pSettings->getLogPath().empty())
-            ? m_pSettings->getLogPath()
-            : fallbackLogPath;
-
-    const std::string& targetPath = logPath.empty() ? defaultPath : logPath;
-
-    // Switch/open log streams if needed
-    if (targetPath != m_currentLogPath) {
-        // Close existing stream if open
-        if (m_logStream.is_open()) {
-            m_logStream.flush();
-            m_logStream.close();
+    if (m_binary.load(std::memory_order_relaxed) &&
+        (logPath.empty() || logPath == defaultPath())) {
+        std::string& record = beginEntry(level, 0);
+        binlog::putArg(record, functionName);
+        binlog::putArg(record, message);
+        commitEntry(level, record);
+        return;
+    }
+    std::string& line = beginLine(level, functionName);
+    line.append(message);
+    commitLine(level, line, logPath);
+}
+
+uint32_t Logger::registerFormat(std::atomic<uint32_t>& formatId,
+                                const LogLevel level,
+                                std::string_view functionName,
+                                std::string_view fmt) const {
+    std::lock_guard<std::mutex> lock(m_formatsMutex);
+    // another thread may have registered the call site meanwhile
+    if (uint32_t id = formatId.load(std::memory_order_relaxed))
+        return id;
+    m_formats.push_back(
+        {level, std::string(functionName), std::string(fmt)});
+    const uint32_t id = static_cast<uint32_t>(m_formats.size());
+    formatId.store(id, std::memory_order_release);
+    return id;
+}
+
+std::string& Logger::beginEntry(const LogLevel level,
+                                uint32_t formatId) const {
+    thread_local std::string record;
+    record.clear();
+    binlog::beginRecord(record, binlog::ENTRY);
+    binlog::put(record, formatId);
+    binlog::put(record, static_cast<uint8_t>(level));
+    binlog::put(record, binlog::cycleCounter());
+    return record;
+}
+
+void Logger::commitEntry(const LogLevel level, std::string& record) const {
+    if (!binlog::finishRecord(record, 0)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    pushToRing(level, record);
+}
+
+// terminates the line and hands it to the calling thread's ring
+void Logger::commitLine(const LogLevel level, std::string& line,
+                        const std::string& logPath) const {
+    // a line has to fit in a ring with room to spare
+    if (line.size() > logRing::CAPACITY / 4) {
+        line.resize(logRing::CAPACITY / 4);
+        line.append("...");
+    }
+    line.push_back('\n');
+
+    if (!logPath.empty() && logPath != defaultPath()) {
+        writeSync(logPath, line);
+        return;
+    }
+    pushToRing(level, line);
+}
+
+void Logger::pushToRing(const LogLevel level, const std::string& bytes) const {
+    logRing& ring = threadRing();
+    const size_t before = ring.tail.load(std::memory_order_relaxed) -
+                          ring.head.load(std::memory_order_relaxed);
+    if (!ring.push(bytes.data(), bytes.size())) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // problems are written out promptly, and a ring filling up is drained
+    // before it starts dropping lines
+    const size_t after = before + bytes.size();
+    if (level >= WARNING ||
+        (before < logRing::CAPACITY / 2 && after >= logRing::CAPACITY / 2)) {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_wakeRequested = true;
+        }
+        m_wakeCond.notify_one();
+    }
+}
+
+// lines for a file other than the configured log, rare enough to not need
+// the rings
+void Logger::writeSync(const std::string& logPath,
+                       const std::string& line) const {
+    std::lock_guard<std::mutex> lock(m_syncMutex);
+    std::ofstream out(logPath, std::ios::app);
+    if (out)
+        out << line;
+}
+
+// makes sure m_fd refers to the configured log file, falling back to the
+// default one if it cannot be opened
+bool Logger::reopenIfNeeded() {
+    const bool binary = m_binary.load();
+    const std::string suffix = binary ? ".bin" : "";
+    const std::string path = defaultPath() + suffix;
+    if (m_fd >= 0 && path == m_requestedLogPath)
+        return true;
+
+    std::string opened = path;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                    0644);
+    if (fd < 0 && path != FALLBACK_LOG_PATH + suffix) {
+        opened = FALLBACK_LOG_PATH + suffix;
+        fd = ::open(opened.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                    0644);
+        if (fd >= 0 && !binary) {
+            std::string line = "[" + getCurrentTimestamp() +
+                               "] [ERROR] [Logger::log()]: Failed to open "
+                               "custom log file: " +
+                               path + ". Logging to default log instead.\n";
+            (void)!::write(fd, line.data(), line.size());
+        }
+    }
+    if (fd < 0)
+        return false;
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = fd;
+    // keep retrying the configured path only when it changes or the file is
+    // rotated, but rotate the file actually written
+    m_requestedLogPath = path;
+    m_currentLogPath = opened;
+    struct stat st;
+    m_fileSize = (fstat(fd, &st) == 0) ? static_cast<size_t>(st.st_size) : 0;
+    m_openedAt = std::chrono::steady_clock::now();
+    // a new binary file needs every format definition again
+    m_formatsWritten = 0;
+    return true;
+}
+
+bool Logger::shouldRotate(size_t incoming) const {
+    std::shared_ptr<Settings> settings = std::atomic_load(&m_pSettings);
+    if (!settings || m_fileSize == 0)
+        return false;
+    const size_t maxSize = settings->getLogMaxSize() * MIB;
+    if (maxSize && m_fileSize + incoming > maxSize)
+        return true;
+    const uint16_t hours = settings->getLogRotateHours();
+    return hours && std::chrono::steady_clock::now() - m_openedAt >=
+                        std::chrono::hours(hours);
+}
+
+// Renames the current file to <file>.<date>-<time> and closes it, the next
+// write opens a fresh one. Compressing and pruning is left to the archiver.
+// A file that cannot be renamed is kept and written on for another full
+// period, rather than retried on every drain
+void Logger::rotate() {
+    const std::time_t now = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now());
+    std::tm local;
+    localtime_r(&now, &local);
+    char suffix[32];
+    std::strftime(suffix, sizeof(suffix), "%Y%m%d-%H%M%S", &local);
+
+    const std::string base = m_currentLogPath + "." + suffix;
+    std::string target = base;
+    std::error_code ec;
+    for (int n = 1; std::filesystem::exists(target, ec) ||
+                    std::filesystem::exists(target + ".gz", ec);
+         ++n)
+        target = base + "-" + std::to_string(n);
+
+    if (std::rename(m_currentLogPath.c_str(), target.c_str()) != 0) {
+        if (!m_binary.load()) {
+            const std::string line = "[" + getCurrentTimestamp() +
+                                     "] [ERROR] [Logger::rotate()]: Failed "
+                                     "to rename " +
+                                     m_currentLogPath + " to " + target +
+                                     ", rotation postponed\n";
+            (void)!::write(m_fd, line.data(), line.size());
+        }
+        m_fileSize = 0;
+        m_openedAt = std::chrono::steady_clock::now();
+        return;
+    }
+
+    ::close(m_fd);
+    m_fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_archiveMutex);
+        m_archiveQueue.emplace_back(target, m_currentLogPath);
+    }
+    m_archiveCond.notify_one();
+    m_requestedLogPath.clear();
+    m_currentLogPath.clear();
+}
+
+#ifdef HOVIA_HAVE_ZLIB
+// gzips path into path.gz and removes the original
+static bool compressFile(const std::string& path) {
+    // a file pruned while it waited in the queue needs nothing done
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::error_code ec;
+        return !std::filesystem::exists(path, ec);
+    }
+    const std::string tmpPath = path + ".gz.tmp";
+    gzFile out = gzopen(tmpPath.c_str(), "wb6");
+    if (!out)
+        return false;
+    std::vector<char> buf(1 << 16);
+    bool ok = true;
+    while (ok && in) {
+        in.read(buf.data(), static_cast<std::streamsize>(buf.size()));
+        const int got = static_cast<int>(in.gcount());
+        if (got > 0 && gzwrite(out, buf.data(), static_cast<unsigned>(got)) !=
+                           got)
+            ok = false;
+    }
+    ok = (gzclose(out) == Z_OK) && ok;
+    if (!ok || std::rename(tmpPath.c_str(), (path + ".gz").c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::remove(path.c_str());
+    return true;
+}
+#endif
+
+// deletes the oldest rotated files of the log at livePath beyond keep, the
+// rotated names sort by their timestamp
+static void pruneRotated(const std::string& livePath, size_t keep) {
+    const std::filesystem::path path(livePath);
+    const std::string prefix = path.filename().string() + ".";
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    const std::filesystem::path dir =
+        path.has_parent_path() ? path.parent_path() : ".";
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(),
+                                                        prefix) == 0 &&
+            std::isdigit(static_cast<unsigned char>(name[prefix.size()])) &&
+            entry.path().extension() != ".tmp")
+            files.push_back(entry.path());
+    }
+    if (files.size() <= keep)
+        return;
+    // compare without ".gz" so ".<time>-1" sorts after ".<time>"
+    const auto key = [](const std::filesystem::path& file) {
+        return file.extension() == ".gz" ? file.stem().string()
+                                         : file.filename().string();
+    };
+    std::sort(files.begin(), files.end(),
+              [&key](const std::filesystem::path& a,
+                     const std::filesystem::path& b) {
+                  return key(a) < key(b);
+              });
+    for (size_t i = 0; i < files.size() - keep; ++i)
+        std::filesystem::remove(files[i], ec);
+}
+
+bool Logger::archive(const std::string& rotated,
+                     const std::string& livePath) {
+    std::shared_ptr<Settings> settings = std::atomic_load(&m_pSettings);
+    bool ok = true;
+#ifdef HOVIA_HAVE_ZLIB
+    if (settings && settings->getLogCompress())
+        ok = compressFile(rotated);
+#else
+    (void)rotated;
+#endif
+    pruneRotated(livePath, settings ? settings->getLogKeepFiles() : 8);
+    return ok;
+}
+
+// works through the queue, only returning once it is empty after the logger
+// started shutting down
+void Logger::archiverLoop() {
+    while (true) {
+        std::string rotated;
+        std::string livePath;
+        {
+            std::unique_lock<std::mutex> lock(m_archiveMutex);
+            m_archiveCond.wait(lock, [this] {
+                return m_archiveStopping || !m_archiveQueue.empty();
+            });
+            if (m_archiveQueue.empty())
+                break;
+            rotated = m_archiveQueue.front().first;
+            livePath = m_archiveQueue.front().second;
+            m_archiveQueue.erase(m_archiveQueue.begin());
         }
 
-        // Try opening the new log stream
-        m_logStream.open(targetPath, std::ios::app);
-        if (!m_logStream) {
-            // Failed to open new log file
-            // If we are not already on default log, fallback to default or
-            // fallback path
-            if (targetPath != defaultPath) {
-                m_logStream.clear();
-                m_logStream.open(defaultPath, std::ios::app);
-                if (m_logStream) {
-                    m_logStream
-                        << "[" << getCurrentTimestamp()
-                        << "] [ERROR] [Logger::log()]: "
-                        << "Failed to open custom log file: " << targetPath
-                        << ". Logging to default log instead.\n";
-                    m_logStream.flush();
-                    m_currentLogPath = defaultPath;
-                } else {
-                    // Failed to open default log itself; silently fail here
-                    return;
-                }
-            } else {
-                // Failed to open default log itself; silently fail here
-                return;
+        if (!archive(rotated, livePath))
+            log(LogLevel::WARNING, __func__,
+                "Failed to compress rotated log " + rotated);
+    }
+}
+
+// Records the binary sink writes ahead of a batch of entries: definitions of
+// formats first used since the last batch, a clock sync point and the number
+// of dropped lines
+std::string Logger::binaryPreamble(uint64_t dropped) {
+    std::string out;
+    size_t start;
+    // a file just opened, possibly holding earlier runs, starts a run of its
+    // own. It also gets the sync point taken at startup, so that the run
+    // holds two of them to derive the counter rate from
+    if (m_formatsWritten == 0) {
+        start = out.size();
+        binlog::beginRecord(out, binlog::RUN);
+        binlog::put(out, m_startNs);
+        binlog::finishRecord(out, start);
+        start = out.size();
+        binlog::beginRecord(out, binlog::SYNC);
+        binlog::put(out, m_startCounter);
+        binlog::put(out, m_startNs);
+        binlog::finishRecord(out, start);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_formatsMutex);
+        for (; m_formatsWritten < m_formats.size(); ++m_formatsWritten) {
+            const formatDef& def = m_formats[m_formatsWritten];
+            start = out.size();
+            binlog::beginRecord(out, binlog::FORMAT);
+            binlog::put(out, static_cast<uint32_t>(m_formatsWritten + 1));
+            binlog::put(out, static_cast<uint8_t>(def.level));
+            binlog::putString(out, def.functionName);
+            binlog::putString(out, def.fmt);
+            binlog::finishRecord(out, start);
+        }
+    }
+
+    start = out.size();
+    binlog::beginRecord(out, binlog::SYNC);
+    binlog::put(out, binlog::cycleCounter());
+    binlog::put(out, Clock::nowNs());
+    binlog::finishRecord(out, start);
+
+    if (dropped) {
+        start = out.size();
+        binlog::beginRecord(out, binlog::DROPPED);
+        binlog::put(out, dropped);
+        binlog::finishRecord(out, start);
+    }
+    return out;
+}
+
+// Writes out everything currently in the rings with as few writev() calls as
+// possible. Returns false if nothing was pending
+bool Logger::drain() {
+    std::lock_guard<std::mutex> flushLock(m_flushMutex);
+
+    std::vector<std::shared_ptr<logRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings = m_rings;
+    }
+
+    struct pendingRing {
+            logRing* ring;
+            size_t tail;
+    };
+    std::vector<iovec> iov;
+    std::vector<pendingRing> pending;
+    iov.reserve(rings.size() * 2 + 1);
+    // first slot for the dropped line or the binary preamble
+    iov.push_back({nullptr, 0});
+
+    // ring contents are read first, so every format they use is already
+    // registered when the preamble is built
+    for (const auto& ring : rings) {
+        const size_t headPos = ring->head.load(std::memory_order_relaxed);
+        const size_t tailPos = ring->tail.load(std::memory_order_acquire);
+        if (headPos == tailPos)
+            continue;
+        const size_t start = headPos & (logRing::CAPACITY - 1);
+        const size_t len = tailPos - headPos;
+        const size_t first = std::min(len, logRing::CAPACITY - start);
+        iov.push_back({ring->data.get() + start, first});
+        if (len > first)
+            iov.push_back({ring->data.get(), len - first});
+        pending.push_back({ring.get(), tailPos});
+    }
+
+    const uint64_t dropped = m_dropped.exchange(0);
+    const bool hasData = iov.size() > 1 || dropped;
+    std::string head;
+    size_t incoming = 0;
+    for (size_t i = 1; i < iov.size(); ++i)
+        incoming += iov[i].iov_len;
+    if (hasData && reopenIfNeeded() &&
+        (!shouldRotate(incoming) || (rotate(), reopenIfNeeded()))) {
+        if (m_binary.load())
+            head = binaryPreamble(dropped);
+        else if (dropped)
+            head = "[" + getCurrentTimestamp() +
+                   "] [WARNING] [Logger::log()]: Dropped " +
+                   std::to_string(dropped) +
+                   " lines, the log could not keep up\n";
+        iov.front() = {head.data(), head.size()};
+
+        // writev takes at most IOV_MAX buffers and may write partially
+        size_t next = 0;
+        while (next < iov.size()) {
+            const int count =
+                static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+            ssize_t written = ::writev(m_fd, &iov[next], count);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            m_fileSize += static_cast<size_t>(written);
+            size_t remaining = static_cast<size_t>(written);
+            while (next < iov.size() && remaining >= iov[next].iov_len)
+                remaining -= iov[next++].iov_len;
+            if (remaining > 0) {
+                iov[next].iov_base =
+                    static_cast<char*>(iov[next].iov_base) + remaining;
+                iov[next].iov_len -= remaining;
             }
-        } else {
-            m_currentLogPath = targetPath;
         }
     }
 
-    outStream = &m_logStream;
+    // release the space even if the write failed, so logging never stalls
+    for (const pendingRing& p : pending)
+        p.ring->head.store(p.tail, std::memory_order_release);
 
-    (*outStream) << "[" << getCurrentTimestamp() << "] "
-                 << "[" << levelToString(level) << "] "
-                 << "[" << functionName << "()]: " << message << "\n";
-    outStream->flush();
+    // forget rings whose thread has exited once they are empty
+    rings.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.erase(
+            std::remove_if(m_rings.begin(), m_rings.end(),
+                           [](const std::shared_ptr<logRing>& ring) {
+                               return ring.use_count() == 1 &&
+                                      ring->head.load() == ring->tail.load();
+                           }),
+            m_rings.end());
+    }
+    return hasData;
+}
+
+void Logger::flush() { drain(); }
+
+void Logger::flusherLoop() {
+    while (true) {
+        std::shared_ptr<Settings> settings = std::atomic_load(&m_pSettings);
+        const uint16_t interval = settings ? settings->getLogFlushInterval()
+                                           : DEFAULT_FLUSH_INTERVAL_MS;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCond.wait_for(
+                lock,
+                std::chrono::milliseconds(std::max<uint16_t>(1, interval)),
+                [this] { return m_stopping || m_wakeRequested; });
+            m_wakeRequested = false;
+            stopping = m_stopping;
+        }
+        drain();
+        if (stopping)
+            break;
+    }
 }
@@ -1,36 +1,244 @@
 #pragma once
+#include "binary_log.hpp"
 #include "utils/settings/settings.hpp"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <mutex>
-#include <fstream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 enum LogLevel { DEBUG, INFO, WARNING, ERROR, CRITICAL };
 
+// Lowest level the LOG_* macros are compiled in for, e.g.
+// -DHOVIA_LOG_MIN_LEVEL=1 drops every LOG_DEBUG call from the binary
+#ifndef HOVIA_LOG_MIN_LEVEL
+#define HOVIA_LOG_MIN_LEVEL 0
+#endif
+
+// Logging front end for call sites. The message is a format string with {}
+// placeholders, its arguments are only formatted, straight into the line
+// buffer, once the level passed both the build-time minimum and the runtime
+// check. DEBUG lines are emitted only when verbose is on. Each call site
+// gets an id for its format string, used by the binary sink
+#define HOVIA_LOG(level, functionName, ...)                                \
+    do {                                                                   \
+        if constexpr ((level) >= HOVIA_LOG_MIN_LEVEL) {                    \
+            static std::atomic<uint32_t> hoviaFormatId{0};                 \
+            Logger& hoviaLogger = Logger::getInstance();                   \
+            if (hoviaLogger.enabled(level))                                \
+                hoviaLogger.logf((level), (functionName), hoviaFormatId,   \
+                                 __VA_ARGS__);                             \
+        }                                                                  \
+    } while (0)
+
+#define LOG_DEBUG(...) HOVIA_LOG(LogLevel::DEBUG, __func__, __VA_ARGS__)
+#define LOG_INFO(...) HOVIA_LOG(LogLevel::INFO, __func__, __VA_ARGS__)
+#define LOG_WARNING(...) HOVIA_LOG(LogLevel::WARNING, __func__, __VA_ARGS__)
+#define LOG_ERROR(...) HOVIA_LOG(LogLevel::ERROR, __func__, __VA_ARGS__)
+#define LOG_CRITICAL(...) HOVIA_LOG(LogLevel::CRITICAL, __func__, __VA_ARGS__)
+
+// Asynchronous logger. log() formats the line and copies it into a lock-free
+// ring owned by the calling thread; a background thread drains every ring at
+// the configured flush interval and writes the lines to the log file with a
+// single writev(). WARNING and above wake the flusher right away. If a ring
+// is full the line is dropped and counted rather than blocking the caller.
+//
+// With the binaryLog setting the rings carry compact binary records instead
+// (see binary_log.hpp), written to <logPath>.bin and turned back into text
+// by hovia-logdecode.
+//
+// The flusher rotates the file once it reaches logMaxSize or is older than
+// logRotateHours by renaming it to <file>.<date>-<time>. A separate archiver
+// thread compresses rotated files and deletes the oldest beyond logKeepFiles,
+// so neither writers nor the flusher wait on that work.
 class Logger {
     public:
         static Logger& getInstance();
+        ~Logger();
 
+        // takes the log path, flush interval and sink from the app's
+        // settings. Call before other threads start logging, the sink is
+        // fixed from then on
+        void configure(std::shared_ptr<Settings> pSettings);
+
+        // logPath overrides the configured log file, lines for any other file
+        // than the current one are written synchronously
         void log(const LogLevel level, const std::string& functionName,
                  const std::string& message,
                  const std::string& logPath = "") const;
 
+        // formats fmt with args, or records them raw for the binary sink,
+        // see HOVIA_LOG. fmt has to be a string literal
+        template <typename... Args>
+        void logf(const LogLevel level, std::string_view functionName,
+                  std::atomic<uint32_t>& formatId, std::string_view fmt,
+                  const Args&... args) const {
+            if (m_binary.load(std::memory_order_relaxed)) {
+                uint32_t id = formatId.load(std::memory_order_acquire);
+                if (id == 0)
+                    id = registerFormat(formatId, level, functionName, fmt);
+                std::string& record = beginEntry(level, id);
+                (binlog::putArg(record, args), ...);
+                commitEntry(level, record);
+                return;
+            }
+            std::string& line = beginLine(level, functionName);
+            formatTo(line, fmt, args...);
+            commitLine(level, line, "");
+        }
+
+        // runtime level check, DEBUG only passes in verbose mode
+        bool enabled(const LogLevel level) const {
+            if (level != DEBUG)
+                return true;
+            const Settings* settings =
+                m_settingsRaw.load(std::memory_order_relaxed);
+            return settings && settings->hasVerbose();
+        }
+
+        // writes out everything logged so far before returning
+        void flush();
+
         std::string getCurrentTimestamp() const;
 
     private:
-        Logger() = default;
+        // single producer, single consumer byte ring holding finished lines
+        struct logRing {
+                static constexpr size_t CAPACITY = 64 << 10;  // power of two
+                std::unique_ptr<char[]> data{new char[CAPACITY]};
+                std::atomic<size_t> head{0};  // advanced by the flusher
+                std::atomic<size_t> tail{0};  // advanced by the owning thread
+
+                bool push(const char* line, size_t len);
+        };
+
+        Logger();
         Logger(const Logger&) = delete;
         Logger& operator=(const Logger&) = delete;
 
-        void openLogStream(const std::string& logPath);
-        void closeLogStream();
+        // starts a line in the calling thread's buffer with the timestamp,
+        // level and function name
+        std::string& beginLine(const LogLevel level,
+                               std::string_view functionName) const;
+        void commitLine(const LogLevel level, std::string& line,
+                        const std::string& logPath) const;
+        void pushToRing(const LogLevel level, const std::string& bytes) const;
 
-        mutable std::mutex m_logMutex;
+        // binary sink: call sites are numbered from 1 on first use
+        struct formatDef {
+                LogLevel level;
+                std::string functionName;
+                std::string fmt;
+        };
+        uint32_t registerFormat(std::atomic<uint32_t>& formatId,
+                                const LogLevel level,
+                                std::string_view functionName,
+                                std::string_view fmt) const;
+        std::string& beginEntry(const LogLevel level, uint32_t formatId) const;
+        void commitEntry(const LogLevel level, std::string& record) const;
+        std::string binaryPreamble(uint64_t dropped);
+
+        static void appendArg(std::string& out, std::string_view value) {
+            out.append(value);
+        }
+        static void appendArg(std::string& out, const char* value) {
+            out.append(value);
+        }
+        static void appendArg(std::string& out, char value) {
+            out.push_back(value);
+        }
+        static void appendArg(std::string& out, bool value) {
+            out.append(value ? "true" : "false");
+        }
+        template <typename T>
+        static std::enable_if_t<std::is_arithmetic_v<T>> appendArg(
+            std::string& out, T value) {
+            char buf[32];
+            std::to_chars_result res =
+                std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, res.ptr);
+        }
+
+        static void formatTo(std::string& out, std::string_view fmt) {
+            out.append(fmt);
+        }
+        template <typename T, typename... Rest>
+        static void formatTo(std::string& out, std::string_view fmt,
+                             const T& first, const Rest&... rest) {
+            const size_t pos = fmt.find("{}");
+            if (pos == std::string_view::npos) {
+                out.append(fmt);
+                return;
+            }
+            out.append(fmt.substr(0, pos));
+            appendArg(out, first);
+            formatTo(out, fmt.substr(pos + 2), rest...);
+        }
+
+        logRing& threadRing() const;
+        std::string defaultPath() const;
+        void writeSync(const std::string& logPath,
+                       const std::string& line) const;
+        void flusherLoop();
+        bool drain();
+        bool reopenIfNeeded();
+        bool shouldRotate(size_t incoming) const;
+        void rotate();
+        void archiverLoop();
+        // compresses and prunes one rotated file, false if it could not be
+        // compressed
+        bool archive(const std::string& rotated, const std::string& livePath);
+
+        // swapped with std::atomic_store, read by every logging thread
         std::shared_ptr<Settings> m_pSettings;
-        mutable std::ofstream m_logStream;
-        mutable std::string m_currentLogPath;
+        // same object, for the lock-free verbose check in enabled()
+        std::atomic<const Settings*> m_settingsRaw{nullptr};
+
+        // rings of every thread that has logged, a ring outlives its thread
+        // until the flusher has drained it
+        mutable std::mutex m_ringsMutex;
+        mutable std::vector<std::shared_ptr<logRing>> m_rings;
+
+        mutable std::mutex m_flushMutex;  // serializes drains
+        mutable std::mutex m_wakeMutex;
+        mutable std::condition_variable m_wakeCond;
+        mutable bool m_wakeRequested = false;
+        bool m_stopping = false;
+        std::thread m_flusher;
+
+        std::atomic<bool> m_binary{false};
+        mutable std::mutex m_formatsMutex;
+        mutable std::vector<formatDef> m_formats;
+        size_t m_formatsWritten = 0;  // definitions already in the open file
+        const uint64_t m_startCounter;
+        const int64_t m_startNs;
+
+        int m_fd = -1;
+        // configured path m_fd was opened for, and the file it refers to,
+        // which is the fallback log when the configured one cannot be opened
+        std::string m_requestedLogPath;
+        std::string m_currentLogPath;
+        size_t m_fileSize = 0;
+        std::chrono::steady_clock::time_point m_openedAt;
+        mutable std::atomic<uint64_t> m_dropped{0};
+        mutable std::mutex m_syncMutex;
+
+        // rotated files waiting to be compressed and pruned, paired with the
+        // path of the live file they came from
+        std::mutex m_archiveMutex;
+        std::condition_variable m_archiveCond;
+        std::vector<std::pair<std::string, std::string>> m_archiveQueue;
+        bool m_archiveStopping = false;
+        std::thread m_archiver;
 
-        static std::string levelToString(const LogLevel level);
+        static const char* levelToString(const LogLevel level);
 };
 
 extern std::shared_ptr<Logger> LOGGER;
@@ -81,6 +81,111 @@ uint16_t Settings::getWebsocket() const { return m_WebsocketPort.load(); }
 void Settings::setWebsocket(uint16_t newWebsocket) {
     m_WebsocketPort.store(newWebsocket);
 }
+
+uint16_t Settings::getBatchSize() const { return m_batchSize.load(); }
+
+void Settings::setBatchSize(uint16_t val) { m_batchSize.store(val); }
+
+uint16_t Settings::getBatchWindow() const { return m_batchWindow.load(); }
+
+void Settings::setBatchWindow(uint16_t val) { m_batchWindow.store(val); }
+
+uint16_t Settings::getReplaySize() const { return m_replaySize.load(); }
+
+void Settings::setReplaySize(uint16_t val) { m_replaySize.store(val); }
+
+uint16_t Settings::getReplayWindow() const { return m_replayWindow.load(); }
+
+void Settings::setReplayWindow(uint16_t val) { m_replayWindow.store(val); }
+
+uint8_t Settings::getApiThreads() const { return m_apiThreads.load(); }
+
+void Settings::setApiThreads(uint8_t val) { m_apiThreads.store(val); }
+
+uint32_t Settings::getResultBacklog() const { return m_resultBacklog.load(); }
+
+void Settings::setResultBacklog(uint32_t val) { m_resultBacklog.store(val); }
+
+uint32_t Settings::getHistorySize() const { return m_historySize.load(); }
+
+void Settings::setHistorySize(uint32_t val) { m_historySize.store(val); }
+
+uint16_t Settings::getJournalSegments() const {
+    return m_journalSegments.load();
+}
+
+void Settings::setJournalSegments(uint16_t val) {
+    m_journalSegments.store(val);
+}
+
+uint16_t Settings::getSnapshotInterval() const {
+    return m_snapshotInterval.load();
+}
+
+void Settings::setSnapshotInterval(uint16_t val) {
+    m_snapshotInterval.store(val);
+}
+
+uint16_t Settings::getLogFlushInterval() const {
+    return m_logFlushInterval.load();
+}
+
+void Settings::setLogFlushInterval(uint16_t val) {
+    m_logFlushInterval.store(val);
+}
+
+bool Settings::getBinaryLog() const { return m_binaryLog.load(); }
+
+void Settings::setBinaryLog(bool val) { m_binaryLog.store(val); }
+
+uint32_t Settings::getLogMaxSize() const { return m_logMaxSize.load(); }
+
+void Settings::setLogMaxSize(uint32_t val) { m_logMaxSize.store(val); }
+
+uint16_t Settings::getLogRotateHours() const { return m_logRotateHours.load(); }
+
+void Settings::setLogRotateHours(uint16_t val) { m_logRotateHours.store(val); }
+
+uint16_t Settings::getLogKeepFiles() const { return m_logKeepFiles.load(); }
+
+void Settings::setLogKeepFiles(uint16_t val) { m_logKeepFiles.store(val); }
+
+bool Settings::getLogCompress() const { return m_logCompress.load(); }
+
+void Settings::setLogCompress(bool val) { m_logCompress.store(val); }
+
+uint16_t Settings::getPipelineTraceSample() const {
+    return m_pipelineTraceSample.load();
+}
+
+void Settings::setPipelineTraceSample(uint16_t val) {
+    m_pipelineTraceSample.store(val);
+}
+
+uint16_t Settings::getLookupThreadsMin() const {
+    return m_lookupThreadsMin.load();
+}
+
+void Settings::setLookupThreadsMin(uint16_t val) {
+    m_lookupThreadsMin.store(val);
+}
+
+uint16_t Settings::getLookupThreadsMax() const {
+    return m_lookupThreadsMax.load();
+}
+
+void Settings::setLookupThreadsMax(uint16_t val) {
+    m_lookupThreadsMax.store(val);
+}
+
+bool Settings::getPrioritizeTraffic() const {
+    return m_prioritizeTraffic.load();
+}
+
+void Settings::setPrioritizeTraffic(bool val) {
+    m_prioritizeTraffic.store(val);
+}
+
 // This function receives a path and begins to parse said json file, setting up
 // all of the app's settings atomically and setting up mutexes for all string
 // variables (logPath, interfaceToUse and pcapFilter)
@@ -160,6 +265,25 @@ std::shared_ptr<Settings> Settings::loadFromFile() {
             s->m_hasVerbose.store(j.value("hasVerbose", false));
 
             s->m_WebsocketPort.store(j.value("WebsocketPort", 9002));
+            s->m_batchSize.store(j.value("batchSize", 1));
+            s->m_batchWindow.store(j.value("batchWindow", 50));
+            s->m_replaySize.store(j.value("replaySize", 500));
+            s->m_replayWindow.store(j.value("replayWindow", 0));
+            s->m_apiThreads.store(j.value("apiThreads", 2));
+            s->m_resultBacklog.store(j.value("resultBacklog", 10000));
+            s->m_historySize.store(j.value("historySize", 100000));
+            s->m_journalSegments.store(j.value("journalSegments", 8));
+            s->m_snapshotInterval.store(j.value("snapshotInterval", 60));
+            s->m_logFlushInterval.store(j.value("logFlushInterval", 100));
+            s->m_binaryLog.store(j.value("binaryLog", false));
+            s->m_logMaxSize.store(j.value("logMaxSize", 64));
+            s->m_logRotateHours.store(j.value("logRotateHours", 0));
+            s->m_logKeepFiles.store(j.value("logKeepFiles", 8));
+            s->m_logCompress.store(j.value("logCompress", true));
+            s->m_pipelineTraceSample.store(j.value("pipelineTraceSample", 0));
+            s->m_lookupThreadsMin.store(j.value("lookupThreadsMin", 2));
+            s->m_lookupThreadsMax.store(j.value("lookupThreadsMax", 16));
+            s->m_prioritizeTraffic.store(j.value("prioritizeTraffic", true));
 
         } catch (const std::exception& e) {
             Logger::getInstance().log(LogLevel::ERROR, __func__,
@@ -251,6 +375,25 @@ void Settings::saveToFile() {
     j["hasVerbose"] = m_hasVerbose.load();
 
     j["WebsocketPort"] = m_WebsocketPort.load();
+    j["batchSize"] = m_batchSize.load();
+    j["batchWindow"] = m_batchWindow.load();
+    j["replaySize"] = m_replaySize.load();
+    j["replayWindow"] = m_replayWindow.load();
+    j["apiThreads"] = m_apiThreads.load();
+    j["resultBacklog"] = m_resultBacklog.load();
+    j["historySize"] = m_historySize.load();
+    j["journalSegments"] = m_journalSegments.load();
+    j["snapshotInterval"] = m_snapshotInterval.load();
+    j["logFlushInterval"] = m_logFlushInterval.load();
+    j["binaryLog"] = m_binaryLog.load();
+    j["logMaxSize"] = m_logMaxSize.load();
+    j["logRotateHours"] = m_logRotateHours.load();
+    j["logKeepFiles"] = m_logKeepFiles.load();
+    j["logCompress"] = m_logCompress.load();
+    j["pipelineTraceSample"] = m_pipelineTraceSample.load();
+    j["lookupThreadsMin"] = m_lookupThreadsMin.load();
+    j["lookupThreadsMax"] = m_lookupThreadsMax.load();
+    j["prioritizeTraffic"] = m_prioritizeTraffic.load();
 
     std::ofstream out(configFilePath);
     if (!out) {
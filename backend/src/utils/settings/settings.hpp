@@ -18,6 +18,25 @@
  * 9. Theme
  * 10. Max hops
  * 11. Websocket port
+ * 12. Websocket batch size
+ * 13. Websocket batch window (ms)
+ * 14. Replay buffer size (results)
+ * 15. Replay buffer window (minutes)
+ * 16. API thread pool size
+ * 17. Result backlog kept while no client is connected
+ * 18. Trace history size (results queryable via /api/traces)
+ * 19. Journal segments kept on disk (0 disables the journal)
+ * 20. Warm-start snapshot interval (seconds, 0 only snapshots on stop)
+ * 21. Log flush interval (ms)
+ * 22. Binary log sink (decoded with hovia-logdecode)
+ * 23. Log file size that triggers rotation (MiB, 0 disables)
+ * 24. Log rotation interval (hours, 0 disables)
+ * 25. Rotated log files kept
+ * 26. Compress rotated log files
+ * 27. Percentage of destinations written to pipeline_trace.json (0 disables)
+ * 28. Fewest lookup threads kept running, the pool never shrinks below this
+ * 29. Most lookup threads the pool grows to while destinations back up
+ * 30. Trace destinations carrying the most traffic first
  */
 
 enum class LookupMode { AUTO, DB, API };
@@ -51,6 +70,25 @@ struct Settings {
 
         std::atomic<uint8_t> m_maxHops = 15;
         std::atomic<uint16_t> m_WebsocketPort{9002};
+        std::atomic<uint16_t> m_batchSize{1};
+        std::atomic<uint16_t> m_batchWindow{50};
+        std::atomic<uint16_t> m_replaySize{500};
+        std::atomic<uint16_t> m_replayWindow{0};
+        std::atomic<uint8_t> m_apiThreads{2};
+        std::atomic<uint32_t> m_resultBacklog{10000};
+        std::atomic<uint32_t> m_historySize{100000};
+        std::atomic<uint16_t> m_journalSegments{8};
+        std::atomic<uint16_t> m_snapshotInterval{60};
+        std::atomic<uint16_t> m_logFlushInterval{100};
+        std::atomic<bool> m_binaryLog{false};
+        std::atomic<uint32_t> m_logMaxSize{64};
+        std::atomic<uint16_t> m_logRotateHours{0};
+        std::atomic<uint16_t> m_logKeepFiles{8};
+        std::atomic<bool> m_logCompress{true};
+        std::atomic<uint16_t> m_pipelineTraceSample{0};
+        std::atomic<uint16_t> m_lookupThreadsMin{2};
+        std::atomic<uint16_t> m_lookupThreadsMax{16};
+        std::atomic<bool> m_prioritizeTraffic{true};
 
     public:
         static std::shared_ptr<Settings> loadFromFile();
@@ -88,4 +126,61 @@ struct Settings {
 
         int getMaxHops() const;
         void setMaxHops(const int val);
+
+        uint16_t getBatchSize() const;
+        void setBatchSize(uint16_t val);
+
+        uint16_t getBatchWindow() const;
+        void setBatchWindow(uint16_t val);
+
+        uint16_t getReplaySize() const;
+        void setReplaySize(uint16_t val);
+
+        uint16_t getReplayWindow() const;
+        void setReplayWindow(uint16_t val);
+
+        uint8_t getApiThreads() const;
+        void setApiThreads(uint8_t val);
+
+        uint32_t getResultBacklog() const;
+        void setResultBacklog(uint32_t val);
+
+        uint32_t getHistorySize() const;
+        void setHistorySize(uint32_t val);
+
+        uint16_t getJournalSegments() const;
+        void setJournalSegments(uint16_t val);
+
+        uint16_t getSnapshotInterval() const;
+        void setSnapshotInterval(uint16_t val);
+
+        uint16_t getLogFlushInterval() const;
+        void setLogFlushInterval(uint16_t val);
+
+        bool getBinaryLog() const;
+        void setBinaryLog(bool val);
+
+        uint32_t getLogMaxSize() const;
+        void setLogMaxSize(uint32_t val);
+
+        uint16_t getLogRotateHours() const;
+        void setLogRotateHours(uint16_t val);
+
+        uint16_t getLogKeepFiles() const;
+        void setLogKeepFiles(uint16_t val);
+
+        bool getLogCompress() const;
+        void setLogCompress(bool val);
+
+        uint16_t getPipelineTraceSample() const;
+        void setPipelineTraceSample(uint16_t val);
+
+        uint16_t getLookupThreadsMin() const;
+        void setLookupThreadsMin(uint16_t val);
+
+        uint16_t getLookupThreadsMax() const;
+        void setLookupThreadsMax(uint16_t val);
+
+        bool getPrioritizeTraffic() const;
+        void setPrioritizeTraffic(bool val);
 };
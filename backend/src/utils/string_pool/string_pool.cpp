@@ -0,0 +1,99 @@
+#include "string_pool.hpp"
+#include <cstring>
+#include <mutex>
+
+StringPool& StringPool::getInstance() {
+    static StringPool instance;
+    return instance;
+}
+
+// id 0 is reserved for the empty string so that a zero-initialised destInfo
+// resolves to empty fields
+StringPool::StringPool() {
+    m_segments[0] = std::make_unique<std::string_view[]>(SEGMENT_SIZE);
+    m_ids.emplace(std::string_view{}, 0);
+    m_size.store(1, std::memory_order_release);
+}
+
+std::string_view StringPool::store(std::string_view str) {
+    // strings larger than a block get a dedicated allocation
+    if (str.size() > ARENA_BLOCK_SIZE) {
+        m_blocks.push_back(std::make_unique<char[]>(str.size()));
+        m_arenaBytes += str.size();
+        std::memcpy(m_blocks.back().get(), str.data(), str.size());
+        return {m_blocks.back().get(), str.size()};
+    }
+
+    if (ARENA_BLOCK_SIZE - m_blockUsed < str.size()) {
+        m_blocks.push_back(std::make_unique<char[]>(ARENA_BLOCK_SIZE));
+        m_arenaBytes += ARENA_BLOCK_SIZE;
+        m_currentBlock = m_blocks.back().get();
+        m_blockUsed = 0;
+    }
+
+    char* dst = m_currentBlock + m_blockUsed;
+    std::memcpy(dst, str.data(), str.size());
+    m_blockUsed += str.size();
+    return {dst, str.size()};
+}
+
+stringId StringPool::intern(std::string_view str) {
+    if (str.empty())
+        return 0;
+
+    // fast path, almost every lookup hits a string that is already known
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_ids.find(str);
+        if (it != m_ids.end())
+            return it->second;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_ids.find(str);
+    if (it != m_ids.end())
+        return it->second;
+
+    stringId id = m_size.load(std::memory_order_relaxed);
+    std::size_t segment = id / SEGMENT_SIZE;
+    if (segment >= MAX_SEGMENTS)
+        return 0;
+    if (!m_segments[segment])
+        m_segments[segment] =
+            std::make_unique<std::string_view[]>(SEGMENT_SIZE);
+
+    std::string_view stored = store(str);
+    m_segments[segment][id % SEGMENT_SIZE] = stored;
+    m_ids.emplace(stored, id);
+    // publish the entry, readers in view() synchronise on this store
+    m_size.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+bool StringPool::find(std::string_view str, stringId& id) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_ids.find(str);
+    if (it == m_ids.end())
+        return false;
+    id = it->second;
+    return true;
+}
+
+std::string_view StringPool::view(stringId id) const {
+    if (id >= m_size.load(std::memory_order_acquire))
+        return {};
+    return m_segments[id / SEGMENT_SIZE][id % SEGMENT_SIZE];
+}
+
+std::size_t StringPool::size() const {
+    return m_size.load(std::memory_order_acquire);
+}
+
+std::size_t StringPool::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::size_t segments = 0;
+    for (const auto& segment : m_segments)
+        if (segment)
+            ++segments;
+    return m_arenaBytes + segments * SEGMENT_SIZE * sizeof(std::string_view);
+}
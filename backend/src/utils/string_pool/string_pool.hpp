@@ -0,0 +1,62 @@
+#pragma once
+#include "utils/common_structs.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Global, append-only table mapping repeated metadata strings (countries,
+// ISPs, AS names...) to small integer ids. Ids and the views returned for them
+// are never invalidated, so they can be stored in traceResult, used as keys by
+// caches and filters and resolved back whenever a result is serialized.
+//
+// Resolving an id is lock-free: entries live in fixed segments that never move
+// and are published through an atomic counter. Interning takes a shared lock
+// for the common case of an already known string and an exclusive one only
+// when a new string has to be appended.
+class StringPool {
+    public:
+        static StringPool& getInstance();
+
+        // returns the id of str, adding it to the pool if it is not present.
+        // Returns 0 (the empty string) once the pool is full
+        stringId intern(std::string_view str);
+        // looks str up without adding it, returns false if it was never
+        // interned
+        bool find(std::string_view str, stringId& id) const;
+        // returns the string stored under id, or an empty view for unknown ids
+        std::string_view view(stringId id) const;
+
+        // number of distinct strings, including the reserved empty string
+        std::size_t size() const;
+        // bytes held by the string arena and the id segments
+        std::size_t memoryUsage() const;
+
+    private:
+        StringPool();
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+        static constexpr std::size_t SEGMENT_SIZE = 4096;
+        static constexpr std::size_t MAX_SEGMENTS = 1024;
+        static constexpr std::size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+        // copies str into the arena and returns a view of the stable copy,
+        // must be called with the exclusive lock held
+        std::string_view store(std::string_view str);
+
+        mutable std::shared_mutex m_mutex;
+        std::atomic<stringId> m_size{0};
+        std::array<std::unique_ptr<std::string_view[]>, MAX_SEGMENTS>
+            m_segments;
+        std::unordered_map<std::string_view, stringId> m_ids;
+
+        std::vector<std::unique_ptr<char[]>> m_blocks;
+        char* m_currentBlock = nullptr;
+        std::size_t m_blockUsed = ARENA_BLOCK_SIZE;
+        std::size_t m_arenaBytes = 0;
+};
@@ -0,0 +1,77 @@
+#include "traffic_sketch.hpp"
+#include <algorithm>
+#include <limits>
+
+// odd multipliers giving each row an independent multiplicative hash
+static constexpr uint32_t ROW_SEEDS[] = {0x9E3779B1u, 0x85EBCA77u,
+                                         0xC2B2AE3Du, 0x27D4EB2Fu};
+
+TrafficSketch::TrafficSketch()
+    : m_nextDecay(std::chrono::steady_clock::now() + HALF_LIFE) {}
+
+// folds the high half of the address into the low one first, so
+// destinations in the same /16 still spread, then keeps the top bits of
+// the product
+size_t TrafficSketch::slot(uint32_t ip, size_t row) {
+    const uint32_t h = (ip ^ (ip >> 16)) * ROW_SEEDS[row];
+    return h >> (32 - WIDTH_BITS);
+}
+
+TrafficSketch::estimate TrafficSketch::add(uint32_t ip, uint32_t bytes) {
+    if (++m_sinceCheck >= DECAY_CHECK_PACKETS) {
+        m_sinceCheck = 0;
+        decay();
+    }
+
+    cell* cells[DEPTH];
+    estimate est{std::numeric_limits<uint64_t>::max(),
+                 std::numeric_limits<uint64_t>::max()};
+    for (size_t row = 0; row < DEPTH; ++row) {
+        cells[row] = &m_rows[row][slot(ip, row)];
+        est.packets = std::min(est.packets, cells[row]->packets);
+        est.bytes = std::min(est.bytes, cells[row]->bytes);
+    }
+    est.packets += 1;
+    est.bytes += bytes;
+    for (cell* c : cells) {
+        c->packets = std::max(c->packets, est.packets);
+        c->bytes = std::max(c->bytes, est.bytes);
+    }
+    return est;
+}
+
+TrafficSketch::estimate TrafficSketch::get(uint32_t ip) const {
+    estimate est{std::numeric_limits<uint64_t>::max(),
+                 std::numeric_limits<uint64_t>::max()};
+    for (size_t row = 0; row < DEPTH; ++row) {
+        const cell& c = m_rows[row][slot(ip, row)];
+        est.packets = std::min(est.packets, c.packets);
+        est.bytes = std::min(est.bytes, c.bytes);
+    }
+    return est;
+}
+
+void TrafficSketch::clear() {
+    m_rows = {};
+    m_sinceCheck = 0;
+    m_nextDecay = std::chrono::steady_clock::now() + HALF_LIFE;
+}
+
+// halves every counter once per elapsed HALF_LIFE, a long quiet spell
+// clears them
+void TrafficSketch::decay() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now < m_nextDecay)
+        return;
+    unsigned shift = 0;
+    for (; m_nextDecay <= now && shift < 64; ++shift)
+        m_nextDecay += HALF_LIFE;
+    if (m_nextDecay <= now)
+        m_nextDecay = now + HALF_LIFE;
+    for (auto& row : m_rows) {
+        for (cell& c : row) {
+            c.packets = shift >= 64 ? 0 : c.packets >> shift;
+            c.bytes = shift >= 64 ? 0 : c.bytes >> shift;
+        }
+    }
+}
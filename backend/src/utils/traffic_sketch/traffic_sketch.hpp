@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Count-min sketch of the packets and bytes sent to each destination, in a
+// fixed 128 KiB however many destinations there are. Updates are
+// conservative, only raising the counters that hold the current minimum, so
+// an estimate is never below the true count and is only inflated by the
+// destinations it collides with in every row. All counters are halved every
+// HALF_LIFE, so estimates weigh recent traffic over old.
+//
+// Not thread-safe, it belongs to the capture thread.
+class TrafficSketch {
+    public:
+        struct estimate {
+                uint64_t packets;
+                uint64_t bytes;
+        };
+
+        TrafficSketch();
+        // counts a packet of the given size to ip and returns the traffic
+        // estimated for it including that packet
+        estimate add(uint32_t ip, uint32_t bytes);
+        estimate get(uint32_t ip) const;
+        void clear();
+
+    private:
+        static constexpr size_t DEPTH = 4;
+        static constexpr size_t WIDTH_BITS = 11;
+        static constexpr size_t WIDTH = size_t(1) << WIDTH_BITS;
+        static constexpr auto HALF_LIFE = std::chrono::seconds(30);
+        // packets between two checks of the clock for a due decay
+        static constexpr uint32_t DECAY_CHECK_PACKETS = 256;
+
+        struct cell {
+                uint64_t packets;
+                uint64_t bytes;
+        };
+
+        static size_t slot(uint32_t ip, size_t row);
+        void decay();
+
+        std::array<std::array<cell, WIDTH>, DEPTH> m_rows{};
+        uint32_t m_sinceCheck = 0;
+        std::chrono::steady_clock::time_point m_nextDecay;
+};
@@ -0,0 +1,116 @@
+#include "warm_start.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Snapshot layout, in host byte order:
+//   char[4] magic, uint32 version, uint32 seen count, uint32 pending count,
+//   uint32 FNV-1a checksum of the address arrays, then both uint32 arrays
+constexpr char SNAPSHOT_MAGIC[4] = {'H', 'V', 'W', 'S'};
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct snapshotHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t seenCount;
+        uint32_t pendingCount;
+        uint32_t checksum;
+};
+
+static uint32_t checksum(const std::vector<uint32_t>& a,
+                         const std::vector<uint32_t>& b, uint32_t hash) {
+    for (const std::vector<uint32_t>* ips : {&a, &b}) {
+        for (uint32_t ip : *ips) {
+            hash ^= ip;
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+static bool writeAll(int fd, const void* data, size_t len) {
+    const char* pos = static_cast<const char*>(data);
+    while (len > 0) {
+        ssize_t n = ::write(fd, pos, len);
+        if (n <= 0)
+            return false;
+        pos += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool saveWarmState(const std::string& path, const warmState& state) {
+    snapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.seenCount = static_cast<uint32_t>(state.seen.size());
+    header.pendingCount = static_cast<uint32_t>(state.pending.size());
+    header.checksum = checksum(state.seen, state.pending, 2166136261u);
+
+    const std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    if (fd < 0)
+        return false;
+    bool ok = writeAll(fd, &header, sizeof(header)) &&
+              writeAll(fd, state.seen.data(),
+                       state.seen.size() * sizeof(uint32_t)) &&
+              writeAll(fd, state.pending.data(),
+                       state.pending.size() * sizeof(uint32_t)) &&
+              fdatasync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool loadWarmState(const std::string& path, warmState& state) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(snapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    const char* base = static_cast<const char*>(map);
+    snapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    const size_t expected =
+        sizeof(header) + (static_cast<size_t>(header.seenCount) +
+                          header.pendingCount) * sizeof(uint32_t);
+    bool ok = std::memcmp(header.magic, SNAPSHOT_MAGIC,
+                          sizeof(header.magic)) == 0 &&
+              header.version == SNAPSHOT_VERSION && size == expected;
+    if (ok) {
+        const char* ips = base + sizeof(header);
+        state.seen.resize(header.seenCount);
+        std::memcpy(state.seen.data(), ips,
+                    state.seen.size() * sizeof(uint32_t));
+        ips += state.seen.size() * sizeof(uint32_t);
+        state.pending.resize(header.pendingCount);
+        std::memcpy(state.pending.data(), ips,
+                    state.pending.size() * sizeof(uint32_t));
+        ok = checksum(state.seen, state.pending, 2166136261u) ==
+             header.checksum;
+    }
+    munmap(map, size);
+    if (!ok) {
+        state.seen.clear();
+        state.pending.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// State that lets a restarted tracker skip work it already did: the
+// destinations the capture has seen and those still waiting for a lookup.
+// Addresses are in host byte order
+struct warmState {
+        std::vector<uint32_t> seen;
+        std::vector<uint32_t> pending;
+};
+
+// Writes state to path as a compact binary snapshot. The file is written
+// next to path and renamed over it, so a crash never leaves a partial
+// snapshot behind
+bool saveWarmState(const std::string& path, const warmState& state);
+// Maps the snapshot at path and reads it into state. Returns false if there
+// is no snapshot or it is damaged
+bool loadWarmState(const std::string& path, warmState& state);
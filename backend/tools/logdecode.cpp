@@ -0,0 +1,273 @@
+// hovia-logdecode: expands a binary log written with the binaryLog setting
+// back into the text format of the regular log
+//
+// usage: hovia-logdecode app.log.bin [more.bin ...] > app.log.txt
+#include "utils/logger/binary_log.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char* LEVEL_NAMES[] = {"DEBUG", "INFO", "WARNING", "ERROR",
+                                    "CRITICAL"};
+
+struct formatDef {
+        std::string functionName;
+        std::string fmt;
+};
+
+struct syncPoint {
+        uint64_t counter;
+        int64_t ns;
+};
+
+// bounds checked reader over the file contents
+struct reader {
+        const char* pos;
+        const char* end;
+
+        template <typename T>
+        bool get(T& value) {
+            if (static_cast<size_t>(end - pos) < sizeof(T))
+                return false;
+            std::memcpy(&value, pos, sizeof(T));
+            pos += sizeof(T);
+            return true;
+        }
+
+        bool getString(std::string& value) {
+            uint16_t len;
+            if (!get(len) || static_cast<size_t>(end - pos) < len)
+                return false;
+            value.assign(pos, len);
+            pos += len;
+            return true;
+        }
+
+        // reads one tagged argument and renders it like the text logger
+        bool getArg(std::string& value) {
+            uint8_t tag;
+            if (!get(tag))
+                return false;
+            char buf[32];
+            std::to_chars_result res{buf, std::errc()};
+            switch (tag) {
+                case binlog::INT: {
+                    int64_t v;
+                    if (!get(v))
+                        return false;
+                    res = std::to_chars(buf, buf + sizeof(buf), v);
+                    break;
+                }
+                case binlog::UINT: {
+                    uint64_t v;
+                    if (!get(v))
+                        return false;
+                    res = std::to_chars(buf, buf + sizeof(buf), v);
+                    break;
+                }
+                case binlog::DOUBLE: {
+                    double v;
+                    if (!get(v))
+                        return false;
+                    res = std::to_chars(buf, buf + sizeof(buf), v);
+                    break;
+                }
+                case binlog::STRING:
+                    return getString(value);
+                case binlog::CHAR: {
+                    char v;
+                    if (!get(v))
+                        return false;
+                    value.assign(1, v);
+                    return true;
+                }
+                case binlog::BOOL: {
+                    uint8_t v;
+                    if (!get(v))
+                        return false;
+                    value = v ? "true" : "false";
+                    return true;
+                }
+                default:
+                    return false;
+            }
+            value.assign(buf, res.ptr);
+            return true;
+        }
+};
+
+// substitutes args into the {} placeholders of fmt, like Logger::formatTo
+static std::string format(const std::string& fmt,
+                          const std::vector<std::string>& args) {
+    std::string out;
+    size_t pos = 0;
+    for (const std::string& arg : args) {
+        const size_t next = fmt.find("{}", pos);
+        if (next == std::string::npos)
+            break;
+        out.append(fmt, pos, next - pos);
+        out.append(arg);
+        pos = next + 2;
+    }
+    out.append(fmt, pos, std::string::npos);
+    return out;
+}
+
+// converts a raw counter to epoch ns using the nearest pair of sync points
+static int64_t toNs(const std::vector<syncPoint>& syncs, uint64_t counter) {
+    if (syncs.empty())
+        return 0;
+    if (syncs.size() == 1)
+        return syncs[0].ns;
+
+    auto it = std::upper_bound(
+        syncs.begin(), syncs.end(), counter,
+        [](uint64_t c, const syncPoint& s) { return c < s.counter; });
+    size_t hi = std::clamp<size_t>(it - syncs.begin(), 1, syncs.size() - 1);
+    const syncPoint& a = syncs[hi - 1];
+    const syncPoint& b = syncs[hi];
+    if (b.counter == a.counter)
+        return a.ns;
+    const double rate = static_cast<double>(b.ns - a.ns) /
+                        static_cast<double>(b.counter - a.counter);
+    return a.ns + static_cast<int64_t>(
+                      (static_cast<double>(counter) -
+                       static_cast<double>(a.counter)) *
+                      rate);
+}
+
+static void appendTimestamp(std::string& out, int64_t ns) {
+    const std::time_t seconds = static_cast<std::time_t>(ns / 1000000000);
+    std::tm local;
+    localtime_r(&seconds, &local);
+    char buf[32];
+    out.append(buf, std::strftime(buf, sizeof(buf), "%F %T", &local));
+}
+
+static bool decodeFile(const std::string& path, std::ostream& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << path << "\n";
+        return false;
+    }
+    const std::string data((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+
+    // first pass: the sync points of every run, an entry is only timed
+    // against those of its own run since the counter restarts with the
+    // process. Records ahead of the first RUN come from a file written
+    // before runs were marked and share run 0
+    std::vector<std::vector<syncPoint>> runs(1);
+    reader r{data.data(), data.data() + data.size()};
+    uint16_t len;
+    uint8_t type;
+    while (r.get(len) && r.get(type) &&
+           static_cast<size_t>(r.end - r.pos) >= len) {
+        reader body{r.pos, r.pos + len};
+        syncPoint sync;
+        if (type == binlog::RUN)
+            runs.emplace_back();
+        else if (type == binlog::SYNC && body.get(sync.counter) &&
+                 body.get(sync.ns))
+            runs.back().push_back(sync);
+        r.pos += len;
+    }
+    for (std::vector<syncPoint>& syncs : runs)
+        std::sort(syncs.begin(), syncs.end(),
+                  [](const syncPoint& a, const syncPoint& b) {
+                      return a.counter < b.counter;
+                  });
+
+    size_t run = 0;
+    std::unordered_map<uint32_t, formatDef> formats;
+    std::vector<std::string> args;
+    std::string line;
+    r = reader{data.data(), data.data() + data.size()};
+    while (r.get(len) && r.get(type)) {
+        if (static_cast<size_t>(r.end - r.pos) < len) {
+            std::cerr << path << ": truncated record at the end\n";
+            break;
+        }
+        reader body{r.pos, r.pos + len};
+        r.pos += len;
+
+        if (type == binlog::RUN) {
+            // format ids are handed out afresh by every run
+            ++run;
+            formats.clear();
+            continue;
+        }
+        if (type == binlog::FORMAT) {
+            uint32_t id;
+            uint8_t level;
+            formatDef def;
+            if (body.get(id) && body.get(level) &&
+                body.getString(def.functionName) && body.getString(def.fmt))
+                formats[id] = std::move(def);
+            continue;
+        }
+        if (type == binlog::DROPPED) {
+            uint64_t dropped;
+            if (body.get(dropped))
+                out << "[...] [WARNING] [Logger::log()]: Dropped " << dropped
+                    << " lines, the log could not keep up\n";
+            continue;
+        }
+        if (type != binlog::ENTRY)
+            continue;
+
+        uint32_t id;
+        uint8_t level;
+        uint64_t counter;
+        if (!body.get(id) || !body.get(level) || !body.get(counter))
+            continue;
+        args.clear();
+        std::string arg;
+        while (body.pos < body.end && body.getArg(arg))
+            args.push_back(arg);
+
+        line.clear();
+        line.push_back('[');
+        appendTimestamp(line, toNs(runs[run], counter));
+        line.append("] [");
+        line.append(level < std::size(LEVEL_NAMES) ? LEVEL_NAMES[level]
+                                                   : "UNKNOWN");
+        line.append("] [");
+        if (id == 0) {
+            // preformatted Logger::log() line
+            line.append(args.size() > 0 ? args[0] : "");
+            line.append("()]: ");
+            line.append(args.size() > 1 ? args[1] : "");
+        } else if (auto it = formats.find(id); it != formats.end()) {
+            line.append(it->second.functionName);
+            line.append("()]: ");
+            line.append(format(it->second.fmt, args));
+        } else {
+            line.append("?()]: <unknown format ");
+            line.append(std::to_string(id));
+            line.append(">");
+        }
+        line.push_back('\n');
+        out << line;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <binary log> [...]\n";
+        return 2;
+    }
+    bool ok = true;
+    for (int i = 1; i < argc; ++i)
+        ok = decodeFile(argv[i], std::cout) && ok;
+    return ok ? 0 : 1;
+}
@@ -88,8 +88,11 @@ function App() {
             socket.onmessage = (event) => {
                 try {
                     const data = JSON.parse(event.data);
-                    if (data?.hops?.length) {
-                        buffer.push(data);
+                    // batched frames carry an array of results
+                    const results = Array.isArray(data) ? data : [data];
+                    const traced = results.filter((r) => r?.hops?.length);
+                    if (traced.length) {
+                        buffer.push(...traced);
                         if (!flushTimeout) {
                             flushTimeout = setTimeout(() => {
                                 flushBuffer();